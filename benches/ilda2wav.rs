@@ -0,0 +1,217 @@
+// Hot paths of ilda2wav: mapping, interpolation, quantization, the wav writers and replaying a cached
+// animation. Throughput is reported in points or in samples per channel.
+
+use criterion::{black_box, criterion_group, criterion_main, BatchSize, Criterion, Throughput};
+use hound::{WavSpec, WavWriter};
+use ilda::animation::Frame;
+use ilda::SimplePoint;
+use ilda_tools::memory_cycle::MemoryCycleIteratorExt;
+use ilda_tools::render::{get_options, hound_writer, pcm_writer, BytesPerSample, Renderer};
+use std::f64::consts::PI;
+use std::io::{self, Seek, SeekFrom, Write};
+
+const CHANNELS: &str = "xyrgbl";
+const SAMPLE_RATE: u32 = 44100;
+const FPS: f64 = 20.0;
+
+// Dense frames: a rose curve of 4000 points with a color ramp and a blanked jump every 50 points.
+fn dense_frames(frames: usize, points: usize) -> Vec<Frame> {
+    (0..frames)
+        .map(|f| {
+            let points = (0..points)
+                .map(|i| {
+                    let t = 2.0 * PI * i as f64 / points as f64;
+                    let r = (4.0 * t + f as f64 * 0.1).cos();
+                    SimplePoint {
+                        x: (r * t.cos() * i16::max_value() as f64) as i16,
+                        y: (r * t.sin() * i16::max_value() as f64) as i16,
+                        r: (i % 256) as u8,
+                        g: (255 - i % 256) as u8,
+                        b: ((i * 7) % 256) as u8,
+                        is_blank: i % 50 == 0,
+                    }
+                })
+                .collect();
+            Frame::new(points, None, None)
+        })
+        .collect()
+}
+
+fn points(frames: &[Frame]) -> u64 {
+    frames
+        .iter()
+        .map(|frame| frame.get_points().len() as u64)
+        .sum()
+}
+
+fn renderer(args: &str) -> Renderer {
+    layout_renderer(args, CHANNELS)
+}
+
+fn layout_renderer(args: &str, channels: &str) -> Renderer {
+    let args = format!(
+        "ilda2wav -r -s {} -f {} {} {}",
+        SAMPLE_RATE, FPS, args, channels
+    );
+    get_options(args.split_whitespace(), None).renderer()
+}
+
+// One second of interleaved samples, every channel a sine of its own frequency.
+fn samples() -> Vec<f64> {
+    let channels = CHANNELS.len();
+    (0..SAMPLE_RATE as usize * channels)
+        .map(|i| {
+            (2.0 * PI * (i / channels) as f64 * (100 + i % channels * 50) as f64
+                / SAMPLE_RATE as f64)
+                .sin()
+        })
+        .collect()
+}
+
+// Takes the bytes of a wav writer without keeping them.
+struct Discard;
+
+impl Write for Discard {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+impl Seek for Discard {
+    fn seek(&mut self, _pos: SeekFrom) -> io::Result<u64> {
+        Ok(0)
+    }
+}
+
+fn bps(bits: u16) -> BytesPerSample {
+    match bits {
+        8 => BytesPerSample::OneByte,
+        16 => BytesPerSample::TwoBytes,
+        _ => BytesPerSample::FourBytes,
+    }
+}
+
+fn bench_points(c: &mut Criterion) {
+    let frames = dense_frames(8, 4000);
+    let mut group = c.benchmark_group("ilda2wav points");
+    group.throughput(Throughput::Elements(points(&frames)));
+
+    // mapping and timing only
+    let mut mapping = renderer("");
+    group.bench_function("map", |b| {
+        b.iter(|| {
+            for frame in &frames {
+                black_box(mapping.count(frame));
+            }
+        })
+    });
+
+    let mut interpolation = renderer("");
+    let mut samples = vec![];
+    group.bench_function("interpolate", |b| {
+        b.iter(|| {
+            for frame in &frames {
+                samples.clear();
+                interpolation.render(frame, &mut samples);
+            }
+            black_box(&samples);
+        })
+    });
+
+    let mut planned = renderer("--mdps 200 --acceleration 50000 --corner 0.1");
+    group.bench_function("interpolate with motion limits", |b| {
+        b.iter(|| {
+            for frame in &frames {
+                samples.clear();
+                planned.render(frame, &mut samples);
+            }
+            black_box(&samples);
+        })
+    });
+
+    // the first pass through the frames stores them, everything after that is a replay
+    let mut replay = frames.iter().cloned().memory_cycle();
+    for _ in &frames {
+        replay.next();
+    }
+    group.bench_function("replay", |b| {
+        b.iter(|| {
+            for _ in &frames {
+                black_box(replay.next());
+            }
+        })
+    });
+
+    group.finish();
+}
+
+fn bench_samples(c: &mut Criterion) {
+    let samples = samples();
+    let mut group = c.benchmark_group("ilda2wav samples");
+    group.throughput(Throughput::Elements(SAMPLE_RATE as u64));
+
+    for bits in &[8, 16, 32] {
+        let mut writer = pcm_writer(io::sink(), bps(*bits));
+        group.bench_function(format!("PcmWriter {} bit", bits), |b| {
+            b.iter(|| writer.write(black_box(&samples)).unwrap())
+        });
+    }
+
+    for bits in &[16, 32] {
+        let spec = WavSpec {
+            channels: CHANNELS.len() as u16,
+            sample_rate: SAMPLE_RATE,
+            bits_per_sample: *bits,
+            sample_format: hound::SampleFormat::Int,
+        };
+        // a new writer for every run, a wav file can not grow beyond 4 GB
+        group.bench_function(format!("HoundWriter {} bit", bits), |b| {
+            b.iter_batched(
+                || hound_writer(WavWriter::new(Discard, spec).unwrap(), bps(*bits)),
+                |mut writer| {
+                    writer.write(black_box(&samples)).unwrap();
+                    writer
+                },
+                BatchSize::SmallInput,
+            )
+        });
+    }
+
+    group.finish();
+}
+
+// The kernels of the common layouts against mapping the same layout channel by channel.
+fn bench_layouts(c: &mut Criterion) {
+    let frames = dense_frames(8, 4000);
+    let mut group = c.benchmark_group("ilda2wav layouts");
+    group.throughput(Throughput::Elements(points(&frames)));
+
+    for channels in &["xy", "xyl", "xyrgb", "__l_xy"] {
+        let mut kernel = layout_renderer("", channels);
+        group.bench_function(format!("{} kernel", channels), |b| {
+            b.iter(|| {
+                for frame in &frames {
+                    kernel.map(black_box(frame));
+                }
+            })
+        });
+
+        let mut per_channel = layout_renderer("", channels).per_channel();
+        group.bench_function(format!("{} per channel", channels), |b| {
+            b.iter(|| {
+                for frame in &frames {
+                    per_channel.map(black_box(frame));
+                }
+            })
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, bench_points, bench_layouts, bench_samples);
+criterion_main!(benches);
@@ -0,0 +1,126 @@
+// Decoding of ildawav2ilda: samples to points, straight from an in memory input.
+// Throughput is reported in samples per channel, every one of them becomes a point.
+// The capture group runs the whole conversion of a multi-GB capture, frames included.
+
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+use ilda::animation::{AnimationStreamWriter, Frame};
+use ilda_tools::point_reader::{Encoding, Fps, FrameCutter, Mapping, SimplePointReader};
+use std::cmp;
+use std::f64::consts::PI;
+use std::io::{self, BufReader, Cursor, Read};
+
+const CHANNELS: &str = "xyrgbl";
+const SAMPLES: usize = 100_000;
+const CAPTURE_BYTES: u64 = 2 << 30;
+
+// Interleaved little endian samples of a lissajous figure, colors and blanking follow the position.
+fn samples(bytes: usize) -> &'static [u8] {
+    let channels = CHANNELS.len();
+    let mut data = Vec::with_capacity(SAMPLES * channels * bytes);
+    for i in 0..SAMPLES {
+        let t = 2.0 * PI * i as f64 / 1000.0;
+        for c in 0..channels {
+            let value = (t * (c + 1) as f64).sin();
+            match bytes {
+                1 => data.push((value * i8::max_value() as f64) as i8 as u8),
+                2 => data
+                    .extend_from_slice(&((value * i16::max_value() as f64) as i16).to_le_bytes()),
+                _ => data
+                    .extend_from_slice(&((value * i32::max_value() as f64) as i32).to_le_bytes()),
+            }
+        }
+    }
+    // the readers want a 'static input, the same data is decoded over and over
+    Box::leak(data.into_boxed_slice())
+}
+
+fn bench_samples(c: &mut Criterion) {
+    let mut group = c.benchmark_group("ildawav2ilda samples");
+    group.throughput(Throughput::Elements(SAMPLES as u64));
+
+    for (name, bytes, encoding) in &[
+        ("8 bit", 1, Encoding::Signed8),
+        ("16 bit", 2, Encoding::Signed16),
+        ("32 bit", 4, Encoding::Signed32),
+    ] {
+        let data = samples(*bytes);
+        group.bench_function(format!("decode {}", name), |b| {
+            b.iter(|| {
+                let mapping = Mapping::new(CHANNELS).unwrap();
+                let reader =
+                    SimplePointReader::new(Box::new(Cursor::new(data)), *encoding, mapping);
+                for point in reader {
+                    black_box(point.unwrap());
+                }
+            })
+        });
+    }
+
+    group.finish();
+}
+
+// A long capture that repeats the same samples, so it does not have to fit into memory
+struct Capture {
+    data: &'static [u8],
+    position: usize,
+    left: u64,
+}
+
+impl Read for Capture {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        if self.position == self.data.len() {
+            self.position = 0;
+        }
+        let len = cmp::min(
+            cmp::min(buf.len(), self.data.len() - self.position) as u64,
+            self.left,
+        ) as usize;
+        buf[..len].copy_from_slice(&self.data[self.position..self.position + len]);
+        self.position += len;
+        self.left -= len as u64;
+        Ok(len)
+    }
+}
+
+fn bench_capture(c: &mut Criterion) {
+    let data = samples(2);
+    let sample_bytes = (CHANNELS.len() * 2) as u64;
+    let samples = CAPTURE_BYTES / sample_bytes;
+
+    let mut group = c.benchmark_group("ildawav2ilda capture");
+    group.throughput(Throughput::Elements(samples));
+    group.sample_size(10);
+
+    group.bench_function("2 GiB at 48 kHz and 29.97 fps", |b| {
+        b.iter(|| {
+            let capture = Capture {
+                data,
+                position: 0,
+                left: samples * sample_bytes,
+            };
+            let mapping = Mapping::new(CHANNELS).unwrap();
+            let reader = SimplePointReader::new(
+                Box::new(BufReader::new(capture)),
+                Encoding::Signed16,
+                mapping,
+            );
+
+            let mut writer = AnimationStreamWriter::new(io::sink());
+            for points in FrameCutter::new(reader, Fps::parse("29.97").unwrap(), 48000) {
+                writer
+                    .write_frame(&Frame::new(
+                        points.unwrap(),
+                        Some(String::from("")),
+                        Some(String::from("")),
+                    ))
+                    .unwrap();
+            }
+            writer.finalize().unwrap();
+        })
+    });
+
+    group.finish();
+}
+
+criterion_group!(benches, bench_samples, bench_capture);
+criterion_main!(benches);
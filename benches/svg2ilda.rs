@@ -0,0 +1,71 @@
+// Flattening of svg2ilda: paths of a parsed svg to ILDA points.
+// Throughput is reported in points of the output.
+
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+use ilda_tools::flatten::to_ilda_points;
+use std::fmt::Write;
+use usvg::{NodeKind, Tree};
+
+// A complex svg: a grid of 20 x 20 rotated groups, each a closed flower of eight cubic curves with a stroke
+// color of its own.
+fn complex_svg() -> String {
+    let mut svg =
+        String::from(r#"<svg xmlns="http://www.w3.org/2000/svg" viewBox="0 0 1000 1000">"#);
+    for row in 0..20 {
+        for column in 0..20 {
+            let mut path = String::from("M 0 -20");
+            for petal in 0..8 {
+                let angle = |step: f64| (petal as f64 + step) * std::f64::consts::PI / 4.0;
+                let (x1, y1) = (45.0 * angle(0.2).sin(), -45.0 * angle(0.2).cos());
+                let (x2, y2) = (45.0 * angle(0.8).sin(), -45.0 * angle(0.8).cos());
+                let (x, y) = (20.0 * angle(1.0).sin(), -20.0 * angle(1.0).cos());
+                write!(
+                    path,
+                    " C {:.3} {:.3} {:.3} {:.3} {:.3} {:.3}",
+                    x1, y1, x2, y2, x, y
+                )
+                .unwrap();
+            }
+            path += " Z";
+            write!(
+                svg,
+                r#"<g transform="translate({} {}) rotate({})"><path d="{}" fill="none" stroke="rgb({},{},{})"/></g>"#,
+                column * 50 + 25,
+                row * 50 + 25,
+                (row * 20 + column) % 45,
+                path,
+                row * 12,
+                column * 12,
+                255 - row * 12
+            )
+            .unwrap();
+        }
+    }
+    svg += "</svg>";
+    svg
+}
+
+fn bench_points(c: &mut Criterion) {
+    let tree = Tree::from_data(complex_svg().as_bytes(), &usvg::Options::default()).unwrap();
+    let root = tree.root();
+    let view_box = match &*root.borrow() {
+        NodeKind::Svg(svg) => svg.view_box,
+        _ => panic!("Not an svg."),
+    };
+
+    let mut group = c.benchmark_group("svg2ilda points");
+
+    for tolerance in &[0.1, 1.0] {
+        let points = to_ilda_points(&root, &view_box, false, *tolerance).len();
+
+        group.throughput(Throughput::Elements(points as u64));
+        group.bench_function(format!("flatten, tolerance {}", tolerance), |b| {
+            b.iter(|| black_box(to_ilda_points(&root, &view_box, false, *tolerance)))
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, bench_points);
+criterion_main!(benches);
@@ -0,0 +1,57 @@
+// Frequency analysis of wav2ilda: the FFT of a window and mapping the spectrum to equalizer bins.
+// Throughput is reported in input samples per channel, a frame advances by sample_rate / fps samples
+// whatever the window size is, so 44100 samples/s is real time at 44.1 kHz.
+
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+use ilda_tools::spectrum::{BinTable, Spectrum, WindowFunction};
+use std::f64::consts::PI;
+
+const SAMPLE_RATE: u32 = 44100;
+const FPS: f64 = 20.0;
+const BINS: u16 = 64;
+
+// A long wav: ten seconds of a chirp from 100 Hz to 10 kHz with some harmonics.
+fn chirp() -> Vec<f64> {
+    let len = SAMPLE_RATE as usize * 10;
+    (0..len)
+        .map(|i| {
+            let t = i as f64 / SAMPLE_RATE as f64;
+            let phase = 2.0 * PI * (100.0 * t + 990.0 * t * t / 2.0);
+            0.6 * phase.sin() + 0.3 * (2.0 * phase).sin() + 0.1 * (3.0 * phase).sin()
+        })
+        .collect()
+}
+
+fn bench_samples(c: &mut Criterion) {
+    let samples = chirp();
+    let sample_duration = (SAMPLE_RATE as f64 / FPS) as usize;
+
+    let mut group = c.benchmark_group("wav2ilda samples");
+    group.throughput(Throughput::Elements(sample_duration as u64));
+
+    for window_size in &[256, 1024, 4096] {
+        let mut spectrum = Spectrum::new(*window_size, WindowFunction::Hann);
+        let mut bins = BinTable::new(*window_size, SAMPLE_RATE, BINS);
+        let mut values = vec![];
+        let mut pos = 0;
+
+        group.bench_function(format!("fft and bins, window {}", window_size), |b| {
+            b.iter(|| {
+                if pos + window_size > samples.len() {
+                    pos = 0;
+                }
+                let window = &samples[pos..pos + window_size];
+                pos += sample_duration;
+
+                values.clear();
+                bins.process(spectrum.process(black_box(window)), &mut values);
+                black_box(&values);
+            })
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, bench_samples);
+criterion_main!(benches);
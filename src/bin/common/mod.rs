@@ -1,3 +0,0 @@
-pub mod timed_iterator;
-pub mod memory_cycle;
-pub mod full_buf_writer;
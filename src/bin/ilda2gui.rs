@@ -1,24 +1,38 @@
-mod common;
-
 use clap::{App, Arg};
-use common::memory_cycle::MemoryCycleIteratorExt;
-use common::timed_iterator::{TimedExt, TimedIteratorStrategy};
 use glium::glutin::dpi::LogicalSize;
-use glium::glutin::{ContextBuilder, ControlFlow, Event, EventsLoop, WindowBuilder, WindowEvent};
+use glium::glutin::{
+    ContextBuilder, ControlFlow, ElementState, Event, EventsLoop, KeyboardInput, VirtualKeyCode,
+    WindowBuilder, WindowEvent,
+};
 use glium::index::{NoIndices, PrimitiveType};
 use glium::uniforms::EmptyUniforms;
-use glium::{Display, DrawParameters, PolygonMode, Program, Surface, VertexBuffer};
+use glium::vertex::VertexBufferSlice;
+use glium::{Display, DrawParameters, PolygonMode, Program, Rect, Surface, VertexBuffer};
 use ilda::animation::{Animation, Frame};
 use ilda::IldaError;
-use std::fs::File;
-use std::io::{self, Read, Error as IoError};
+use ilda::SimplePoint;
+use ilda_tools::frame_index::Source;
+use ilda_tools::memory_cycle::MemoryCycleIteratorExt;
+use ilda_tools::stats::{Format as StatsFormat, Stage, StageTimer, Stats};
+use ilda_tools::timed_iterator::{DropPolicy, TimedExt, TimedIteratorStrategy};
+use std::cell::Cell;
+use std::collections::HashMap;
+use std::io::Error as IoError;
 use std::num::{ParseFloatError, ParseIntError};
+use std::ops::Range;
+use std::rc::Rc;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc::{self, Receiver, Sender, TryRecvError};
+use std::sync::Arc;
+use std::thread;
 
 #[derive(Debug)]
 enum Error {
     IoError(IoError),
     ParseFloatError(ParseFloatError),
     ParseIntError(ParseIntError),
+    InvalidRange,
+    UnknownStatsFormat,
 }
 
 impl From<ParseFloatError> for Error {
@@ -43,31 +57,122 @@ struct OpenGLWindow {
     events_loop: EventsLoop,
     display: Display,
     program: Program,
+    streams: Vec<StreamBuffers>,
+    // streams are drawn side by side in a grid of this many tiles
+    columns: u32,
+    rows: u32,
+    // vertices that may still be kept in their own buffers
+    keep_budget: usize,
+}
+
+// vertex buffers of a single stream
+struct StreamBuffers {
+    // single buffer that frames are streamed through, grows to the largest frame seen so far
+    stream_buffer: VertexBuffer<Vertex>,
+    // frame that currently is in stream_buffer
+    streamed: Option<Arc<Vertices>>,
+    // frames that were uploaded into their own buffer once
+    kept_frames: HashMap<*const Vertices, (Arc<Vertices>, VertexBuffer<Vertex>)>,
 }
 
+// limits the GPU memory used for keeping repeated frames
+const MAX_KEPT_VERTICES: usize = 1 << 22;
+
 #[derive(Copy, Clone)]
+// same layout as an ILDA point (8 bytes), the vertex shader does the normalization
+// the blanking flag is stored as the alpha value (0 or 255)
 struct Vertex {
-    position: [f32; 2],
-    color: [f32; 4],
+    position: [i16; 2],
+    color: [u8; 4],
 }
 glium::implement_vertex!(Vertex, position, color);
 
+// a frame as it is uploaded to the GPU
+type Vertices = Vec<Vertex>;
+
+fn vertex(p: &SimplePoint) -> Vertex {
+    Vertex {
+        position: [p.x, p.y],
+        color: [p.r, p.g, p.b, if p.is_blank { 0 } else { 255 }],
+    }
+}
+
+impl StreamBuffers {
+    fn new(display: &Display) -> StreamBuffers {
+        StreamBuffers {
+            stream_buffer: VertexBuffer::empty_dynamic(display, 1024).unwrap(),
+            streamed: None,
+            kept_frames: HashMap::new(),
+        }
+    }
+
+    // Makes sure the points of frame are in a vertex buffer.
+    // Frames get their own buffer while they fit into keep_budget, all others are streamed.
+    fn upload(&mut self, display: &Display, frame: &Arc<Vertices>, keep_budget: &mut usize) {
+        let key = &**frame as *const Vertices;
+        let streamed = self
+            .streamed
+            .as_ref()
+            .map_or(false, |f| Arc::ptr_eq(f, frame));
+        if streamed || self.kept_frames.contains_key(&key) {
+            return;
+        }
+
+        let len = frame.len();
+
+        if len > 0 && len <= *keep_budget {
+            let buffer = VertexBuffer::immutable(display, frame).unwrap();
+            *keep_budget -= len;
+            // the kept Arc makes sure that no other frame ever gets the same address
+            self.kept_frames.insert(key, (frame.clone(), buffer));
+            return;
+        }
+
+        if self.stream_buffer.len() < len {
+            self.stream_buffer =
+                VertexBuffer::empty_dynamic(display, len.next_power_of_two()).unwrap();
+        } else {
+            // orphan the old storage, so the upload does not wait for the GPU to finish the last frame
+            self.stream_buffer.invalidate();
+        }
+        self.stream_buffer.slice(0..len).unwrap().write(frame);
+        self.streamed = Some(frame.clone());
+    }
+
+    fn vertices(&self, frame: &Arc<Vertices>) -> VertexBufferSlice<Vertex> {
+        let len = frame.len();
+        match self.kept_frames.get(&(&**frame as *const Vertices)) {
+            Some((_, buffer)) => buffer.slice(0..len),
+            None => self.stream_buffer.slice(0..len),
+        }
+        .unwrap()
+    }
+}
+
 impl OpenGLWindow {
-    fn new(dimensions: LogicalSize) -> Self {
+    // Opens a window with one tile of the given size per stream.
+    // keep_frames should only be set if the frames are shown more than once.
+    fn new(size: u32, streams: usize, keep_frames: bool) -> Self {
+        let columns = (streams as f64).sqrt().ceil().max(1.0) as u32;
+        let rows = ((streams as u32 + columns - 1) / columns).max(1);
+
         let events_loop = EventsLoop::new();
         let wb = WindowBuilder::new()
             .with_title("ilda2gui")
-            .with_dimensions(dimensions);
+            .with_dimensions(LogicalSize {
+                width: (size * columns) as f64,
+                height: (size * rows) as f64,
+            });
         let cb = ContextBuilder::new();
         let display = Display::new(wb, cb, &events_loop).unwrap();
         let vertex_shader = r#"
             #version 140
-            in vec2 position;
-            in vec4 color;
+            in ivec2 position;
+            in uvec4 color;
             flat out vec4 color_v;
             void main() {
-                color_v = color;
-                gl_Position = vec4(position, 0.0, 1.0);
+                color_v = vec4(color) / 255.0;
+                gl_Position = vec4(0.99 * vec2(position) / 32767.0, 0.0, 1.0);
             }
         "#;
         let fragment_shader = r#"
@@ -80,63 +185,95 @@ impl OpenGLWindow {
             }
         "#;
         let program = Program::from_source(&display, vertex_shader, fragment_shader, None).unwrap();
+        let streams = (0..streams).map(|_| StreamBuffers::new(&display)).collect();
 
         return OpenGLWindow {
             events_loop,
             display,
             program,
+            streams,
+            columns,
+            rows,
+            keep_budget: if keep_frames { MAX_KEPT_VERTICES } else { 0 },
         };
     }
 
-    fn draw(&self, frame: &Frame) {
-        let points: Vec<Vertex> = frame
-            .get_points()
-            .iter()
-            .map(|p| Vertex {
-                position: [
-                    0.99 * p.x as f32 / i16::max_value() as f32,
-                    0.99 * p.y as f32 / i16::max_value() as f32,
-                ],
-                color: [
-                    p.r as f32 / u8::max_value() as f32,
-                    p.g as f32 / u8::max_value() as f32,
-                    p.b as f32 / u8::max_value() as f32,
-                    if p.is_blank { 0.0 } else { 1.0 },
-                ],
-            })
-            .collect();
+    // Draws the current frame of every stream into its tile, None leaves a tile empty.
+    fn draw(&mut self, frames: &[Option<Arc<Vertices>>]) {
+        for (stream, frame) in self.streams.iter_mut().zip(frames) {
+            if let Some(frame) = frame {
+                stream.upload(&self.display, frame, &mut self.keep_budget);
+            }
+        }
 
-        let vertex_buffer = VertexBuffer::new(&self.display, &points).unwrap();
         let indices = NoIndices(PrimitiveType::LineStrip);
 
         let mut target = self.display.draw();
         target.clear_color(0.0, 0.0, 0.0, 1.0);
-        target
-            .draw(
-                &vertex_buffer,
-                &indices,
-                &self.program,
-                &EmptyUniforms,
-                &DrawParameters {
-                    polygon_mode: PolygonMode::Line,
-                    ..Default::default()
-                },
-            )
-            .unwrap();
+
+        let (width, height) = target.get_dimensions();
+        let (tile_width, tile_height) = (width / self.columns, height / self.rows);
+
+        for (i, (stream, frame)) in self.streams.iter().zip(frames).enumerate() {
+            let frame = match frame {
+                Some(frame) if !frame.is_empty() => frame,
+                _ => continue,
+            };
+
+            // tiles are filled row by row from the top left
+            let (column, row) = (i as u32 % self.columns, i as u32 / self.columns);
+            let viewport = Rect {
+                left: column * tile_width,
+                bottom: height - (row + 1) * tile_height,
+                width: tile_width,
+                height: tile_height,
+            };
+
+            target
+                .draw(
+                    stream.vertices(frame),
+                    &indices,
+                    &self.program,
+                    &EmptyUniforms,
+                    &DrawParameters {
+                        polygon_mode: PolygonMode::Line,
+                        viewport: Some(viewport),
+                        ..Default::default()
+                    },
+                )
+                .unwrap();
+        }
         target.finish().unwrap();
     }
 
-    fn process_events(&mut self) -> ControlFlow {
+    // Handles the pending window events, seek keys that were pressed are added to keys.
+    fn process_events(&mut self, keys: &mut Vec<SeekKey>) -> ControlFlow {
         let mut quit = false;
 
-        self.events_loop.poll_events(|event| {
-            if let Event::WindowEvent {
+        self.events_loop.poll_events(|event| match event {
+            Event::WindowEvent {
                 event: WindowEvent::CloseRequested,
                 ..
-            } = event
-            {
-                quit = true;
-            }
+            } => quit = true,
+            Event::WindowEvent {
+                event:
+                    WindowEvent::KeyboardInput {
+                        input:
+                            KeyboardInput {
+                                state: ElementState::Pressed,
+                                virtual_keycode: Some(key),
+                                ..
+                            },
+                        ..
+                    },
+                ..
+            } => match key {
+                VirtualKeyCode::Left => keys.push(SeekKey::Back),
+                VirtualKeyCode::Right => keys.push(SeekKey::Forward),
+                VirtualKeyCode::Home => keys.push(SeekKey::Start),
+                _ => {}
+            },
+            _ => {}
         });
 
         if quit {
@@ -147,12 +284,275 @@ impl OpenGLWindow {
     }
 }
 
+// how many decoded frames may wait to be drawn
+const QUEUE_LEN: usize = 16;
+
+// a decoded frame and where it belongs
+struct Decoded {
+    // frames decoded before the latest seek are stale
+    generation: u64,
+    number: usize,
+    // None once an indexed input ended
+    vertices: Option<Arc<Vertices>>,
+}
+
+// asks the decoder to continue at the given frame number
+struct Seek {
+    generation: u64,
+    number: usize,
+}
+
+#[derive(Clone, Copy)]
+enum SeekKey {
+    Back,
+    Forward,
+    Start,
+}
+
+fn vertices(frame: &Frame) -> Vertices {
+    frame.get_points().iter().map(vertex).collect()
+}
+
+// Decodes frames on a separate thread, so that slow reads never block the window.
+// Indexed inputs can seek, other inputs are decoded from their start and ignore seeks.
+// queued counts the frames that were sent and not yet received.
+fn decode(
+    source: Source,
+    range: Range<usize>,
+    repeat: bool,
+    queued: Arc<AtomicUsize>,
+) -> (Receiver<Decoded>, Option<Seeker>) {
+    let (sender, receiver) = mpsc::sync_channel(QUEUE_LEN);
+
+    let animation = match source {
+        Source::Indexed(animation) => animation,
+        Source::Stream(mut input) => {
+            thread::spawn(move || {
+                let frames = Animation::stream(&mut input)
+                    .skip(range.start)
+                    .take(range.end - range.start)
+                    .map(|frame| vertices(&frame));
+
+                // frames are shared, so repeating them copies no points
+                let frames: Box<dyn Iterator<Item = Arc<Vertices>>> = if repeat {
+                    Box::new(frames.memory_cycle())
+                } else {
+                    Box::new(frames.map(Arc::new))
+                };
+
+                for (i, frame) in frames.enumerate() {
+                    let decoded = Decoded {
+                        generation: 0,
+                        number: range.start + i,
+                        vertices: Some(frame),
+                    };
+                    queued.fetch_add(1, Ordering::Relaxed);
+                    // the window is gone
+                    if sender.send(decoded).is_err() {
+                        break;
+                    }
+                }
+            });
+
+            return (receiver, None);
+        }
+    };
+
+    let (seek_sender, seeks) = mpsc::channel::<Seek>();
+
+    let end = range.end.min(animation.len());
+    let start = range.start.min(end);
+    let seeker = Seeker {
+        seeks: seek_sender,
+        range: start..end,
+        repeat,
+        generation: Cell::new(0),
+        shown: Cell::new(start),
+    };
+
+    thread::spawn(move || {
+        // repeated frames are kept, so they are decoded once like with a stream
+        let mut kept: Vec<Option<Arc<Vertices>>> = vec![];
+        if repeat {
+            kept.resize(end - start, None);
+        }
+
+        let mut generation = 0;
+        let mut number = start;
+
+        loop {
+            while let Ok(seek) = seeks.try_recv() {
+                generation = seek.generation;
+                number = seek.number;
+            }
+
+            if number >= end && repeat {
+                number = start;
+            }
+
+            let frame = match kept.get(number - start).cloned().flatten() {
+                Some(frame) => Some(frame),
+                None if number < end => animation
+                    .frame(number)
+                    .map(|frame| Arc::new(vertices(&frame))),
+                None => None,
+            };
+            if let (true, Some(frame)) = (repeat, &frame) {
+                kept[number - start] = Some(frame.clone());
+            }
+
+            let ended = frame.is_none();
+            let decoded = Decoded {
+                generation,
+                number,
+                vertices: frame,
+            };
+            queued.fetch_add(1, Ordering::Relaxed);
+            if sender.send(decoded).is_err() {
+                break;
+            }
+
+            if !ended {
+                number += 1;
+                continue;
+            }
+            if start == end {
+                break;
+            }
+
+            // the end stays seekable while the last frames are still on screen
+            match seeks.recv() {
+                Ok(seek) => {
+                    generation = seek.generation;
+                    number = seek.number;
+                }
+                Err(_) => break,
+            }
+        }
+    });
+
+    (receiver, Some(seeker))
+}
+
+// Seeking of a stream. Shared by its queue, which skips stale frames, and the window loop, which seeks.
+struct Seeker {
+    seeks: Sender<Seek>,
+    range: Range<usize>,
+    repeat: bool,
+    generation: Cell<u64>,
+    // number of the last frame that was handed out
+    shown: Cell<usize>,
+}
+
+impl Seeker {
+    // Seeks by the given amount of frames from the frame on screen, wraps around if repeating.
+    fn seek_by(&self, frames: i64) {
+        let (start, end) = (self.range.start as i64, self.range.end as i64);
+        if start == end {
+            return;
+        }
+
+        let target = self.shown.get() as i64 + frames;
+        let number = if self.repeat {
+            start + (target - start).rem_euclid(end - start)
+        } else {
+            target.max(start).min(end - 1)
+        };
+        self.seek_to(number as usize);
+    }
+
+    fn seek_to(&self, number: usize) {
+        self.generation.set(self.generation.get() + 1);
+        self.shown.set(number);
+        // the decoder ended, there is nothing left to seek
+        let _ = self.seeks.send(Seek {
+            generation: self.generation.get(),
+            number,
+        });
+    }
+}
+
+// Hands out decoded frames without ever waiting for the decoder.
+// Yields None if the next frame was not decoded in time, the previous frame should then stay on screen.
+struct FrameQueue {
+    receiver: Receiver<Decoded>,
+    seeker: Option<Rc<Seeker>>,
+    queued: Arc<AtomicUsize>,
+    stats: Option<Arc<Stats>>,
+}
+
+impl Iterator for FrameQueue {
+    type Item = Option<Arc<Vertices>>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let generation = self.seeker.as_ref().map_or(0, |s| s.generation.get());
+
+        loop {
+            let received = self.receiver.try_recv();
+            if received.is_ok() {
+                self.queued.fetch_sub(1, Ordering::Relaxed);
+            }
+
+            match received {
+                // skip the frames that were decoded before the last seek
+                Ok(decoded) if decoded.generation < generation => {}
+                Ok(decoded) => {
+                    if let Some(seeker) = &self.seeker {
+                        seeker.shown.set(decoded.number);
+                    }
+                    return decoded.vertices.map(Some);
+                }
+                Err(TryRecvError::Empty) => {
+                    // the frame was not decoded in time
+                    if let Some(stats) = &self.stats {
+                        stats.over_budget();
+                    }
+                    return Some(None);
+                }
+                Err(TryRecvError::Disconnected) => return None,
+            }
+        }
+    }
+}
+
+// Polls the queues of all streams once per tick and ends once all of them ended.
+struct Streams {
+    queues: Vec<Option<FrameQueue>>,
+}
+
+impl Iterator for Streams {
+    type Item = Vec<Option<Arc<Vertices>>>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.queues.iter().all(Option::is_none) {
+            return None;
+        }
+
+        let frames = self
+            .queues
+            .iter_mut()
+            .map(|queue| {
+                let next = queue.as_mut().and_then(Iterator::next);
+                if next.is_none() {
+                    *queue = None;
+                }
+                next.unwrap_or(None)
+            })
+            .collect();
+
+        Some(frames)
+    }
+}
+
 struct Options {
-    input: Box<dyn Read>,
+    inputs: Vec<Source>,
+    range: Range<usize>,
     strategy: TimedIteratorStrategy,
     repeat: bool,
-    size: i32,
-    fps: f32,
+    size: u32,
+    fps: f64,
+    drop_policy: DropPolicy,
+    stats: Option<Arc<Stats>>,
 }
 
 fn get_options<'a>() -> Result<Options, Error> {
@@ -165,7 +565,7 @@ fn get_options<'a>() -> Result<Options, Error> {
                 .short("s")
                 .long("size")
                 .default_value("800")
-                .help("Sets the width and height of the window.")
+                .help("Sets the width and height of the window. If several files are given, this is the size of each tile.")
                 .takes_value(true),
         )
         .arg(
@@ -177,8 +577,9 @@ fn get_options<'a>() -> Result<Options, Error> {
                 .takes_value(true),
         )
         .arg(
-            Arg::with_name("FILE")
-                .help("Read data from this file. If not given, use STDIN instead.")
+            Arg::with_name("FILES")
+                .help("Read data from these files. Several files are shown side by side in one window. If not given, use STDIN instead.")
+                .multiple(true)
                 .index(1),
         )
         .arg(
@@ -193,13 +594,64 @@ fn get_options<'a>() -> Result<Options, Error> {
                 .long("nosleep")
                 .help("Does not sleep between rendering frames. Only needed if the window should stay reactive with very low fps."),
         )
+        .arg(
+            Arg::with_name("DROP")
+                .short("d")
+                .long("drop")
+                .help("Skips frames that are more than this many frames late, so the animation keeps up with the clock. If not given, no frame is skipped and a slow display slows down the animation instead.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("START")
+                .long("start")
+                .help("Number of the first frame to show, counted from 0.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("END")
+                .long("end")
+                .help("Number of the frame to stop before. If not given, the animation is shown to its end.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("INDEX")
+                .long("index")
+                .help("Keeps the frame index of every file in a sidecar file (FILE.idx) and reuses it while the file does not change. Files are indexed, so the left and right arrow keys seek by one second and the home key jumps back to the start.")
+        )
+        .arg(
+            Arg::with_name("STATS")
+                .long("stats")
+                .help("Reports runtime statistics on STDERR about once per second: frames and points drawn per second, frames over budget (not decoded in time, the previous frame stays on screen), frames dropped to keep up with the clock, the decode queue of all files and the time of the render stage (drawing, mean/p99/max). Give json to print every report as one JSON line.")
+                .takes_value(true)
+                .min_values(0),
+        )
         .get_matches();
 
-    let input: Box<dyn Read> = match matches.value_of("FILE") {
-        Some(filename) => Box::new(File::open(filename)?),
-        None => Box::new(io::stdin()),
+    let cache = matches.is_present("INDEX");
+
+    let inputs: Vec<Source> = match matches.values_of("FILES") {
+        Some(filenames) => {
+            let mut inputs: Vec<Source> = vec![];
+            for filename in filenames {
+                inputs.push(Source::open(Some(filename), true, cache)?);
+            }
+            inputs
+        }
+        None => vec![Source::open(None, false, false)?],
     };
 
+    let start = match matches.value_of("START") {
+        Some(start) => start.parse()?,
+        None => 0,
+    };
+    let end = match matches.value_of("END") {
+        Some(end) => end.parse()?,
+        None => usize::max_value(),
+    };
+    if end <= start {
+        return Err(Error::InvalidRange);
+    }
+
     let repeat = matches.is_present("REPEAT");
 
     let strategy = if matches.is_present("NOSLEEP") {
@@ -212,39 +664,128 @@ fn get_options<'a>() -> Result<Options, Error> {
 
     let fps = matches.value_of("FPS").unwrap().parse()?;
 
+    let drop_policy = match matches.value_of("DROP") {
+        Some(frames) => DropPolicy::After(frames.parse::<u32>()?.max(1)),
+        None => DropPolicy::Never,
+    };
+
+    let stats = if matches.is_present("STATS") {
+        match StatsFormat::parse(matches.value_of("STATS")) {
+            Some(format) => Some(Stats::start(format)),
+            None => return Err(Error::UnknownStatsFormat),
+        }
+    } else {
+        None
+    };
+
     Ok(Options {
-        input,
+        inputs,
+        range: start..end,
         repeat,
         strategy,
         size,
         fps,
+        drop_policy,
+        stats,
     })
 }
 
 fn main() -> Result<(), Error> {
-    let mut options = get_options()?;
+    let options = get_options()?;
+
+    let mut window = OpenGLWindow::new(options.size, options.inputs.len(), options.repeat);
+
+    let repeat = options.repeat;
+    let range = options.range;
+    let stats = options.stats;
+    let queued = Arc::new(AtomicUsize::new(0));
+    let (receivers, seekers): (Vec<_>, Vec<_>) = options
+        .inputs
+        .into_iter()
+        .map(|input| {
+            let (receiver, seeker) = decode(input, range.clone(), repeat, queued.clone());
+            (receiver, seeker.map(Rc::new))
+        })
+        .unzip();
+
+    // start the clock once the first frame of every stream is there
+    let first = receivers
+        .iter()
+        .map(|receiver| {
+            let decoded = receiver.recv().ok()?;
+            queued.fetch_sub(1, Ordering::Relaxed);
+            decoded.vertices
+        })
+        .collect();
+
+    let streams = Streams {
+        queues: receivers
+            .into_iter()
+            .zip(&seekers)
+            .map(|(receiver, seeker)| {
+                Some(FrameQueue {
+                    receiver,
+                    seeker: seeker.clone(),
+                    queued: queued.clone(),
+                    stats: stats.clone(),
+                })
+            })
+            .collect(),
+    };
 
-    let animation_stream = Animation::stream(&mut options.input);
+    // seek keys move by one second
+    let seek_frames = options.fps.round().max(1.0) as i64;
 
-    let mut window = OpenGLWindow::new(LogicalSize {
-        width: options.size as f64,
-        height: options.size as f64,
-    });
+    let mut iter = std::iter::once(first)
+        .chain(streams)
+        .timed(options.fps, options.strategy)
+        .drop_policy(options.drop_policy);
 
-    let mut iter: Box<Iterator<Item = Frame>> = Box::new(animation_stream);
+    let mut frames = vec![];
+    let mut keys = vec![];
+    let stats = stats.as_deref();
+    // frames the timed iterator dropped so far
+    let mut dropped = 0;
 
-    if options.repeat {
-        iter = Box::new(iter.memory_cycle());
-    }
+    while let Some(next) = iter.next() {
+        if let ControlFlow::Break = window.process_events(&mut keys) {
+            break;
+        }
 
-    let iter = iter.timed(options.fps, options.strategy);
+        for key in keys.drain(..) {
+            for seeker in seekers.iter().flatten() {
+                match key {
+                    SeekKey::Back => seeker.seek_by(-seek_frames),
+                    SeekKey::Forward => seeker.seek_by(seek_frames),
+                    SeekKey::Start => seeker.seek_to(range.start),
+                }
+            }
+        }
 
-    for frame in iter {
-        if let ControlFlow::Break = window.process_events() {
-            break;
+        if let Some(stats) = stats {
+            stats.dropped_frames((iter.dropped() - dropped) as usize);
+            dropped = iter.dropped();
+            stats.queue(queued.load(Ordering::Relaxed));
+            for frame in next.iter().flatten() {
+                stats.frame(frame.len());
+            }
         }
 
-        window.draw(&frame);
+        // streams without a new frame keep showing their previous one
+        frames.resize(next.len(), None);
+        for (frame, next) in frames.iter_mut().zip(next) {
+            if next.is_some() {
+                *frame = next;
+            }
+        }
+
+        let mut timer = StageTimer::new(stats);
+        window.draw(&frames);
+        timer.lap(Stage::Render);
+    }
+
+    if let Some(stats) = stats {
+        stats.report();
     }
 
     Ok(())
@@ -1,30 +1,29 @@
-use byteorder::{LittleEndian, ReadBytesExt};
 use clap::{App, Arg};
-use hound::{Error as HoundError, WavReader};
+use hound::{Error as HoundError, SampleFormat, WavReader};
 use ilda::animation::{AnimationStreamWriter, Frame};
-use ilda::{IldaError, SimplePoint};
+use ilda::IldaError;
+use ilda_tools::input::Input;
+use ilda_tools::point_reader::{Encoding, Fps, FrameCutter, Mapping, SimplePointReader};
+use ilda_tools::stats::{Format as StatsFormat, Stage, StageTimer, Stats};
 use std::fs::File;
-use std::io::{self, Error as IoError, ErrorKind, Read, Write};
-use std::num::{ParseFloatError, ParseIntError};
+use std::io::{self, BufRead, Error as IoError, Read, Write};
+use std::num::ParseIntError;
+use std::sync::Arc;
 
 #[derive(Debug)]
 enum Error {
     IoError(IoError),
     FailedToInferInputFile,
     UnsupportedBitsPerSample,
-    ParseFloatError(ParseFloatError),
+    UnsupportedSampleFormat,
     ParseIntError(ParseIntError),
     InvalidChannel(char),
+    InvalidFps,
+    UnknownStatsFormat,
     IldaError(IldaError),
     HoundError(HoundError),
 }
 
-impl From<ParseFloatError> for Error {
-    fn from(error: ParseFloatError) -> Self {
-        Error::ParseFloatError(error)
-    }
-}
-
 impl From<ParseIntError> for Error {
     fn from(error: ParseIntError) -> Self {
         Error::ParseIntError(error)
@@ -49,124 +48,15 @@ impl From<HoundError> for Error {
     }
 }
 
-enum BytesPerSample {
-    OneByte,
-    TwoBytes,
-    FourBytes,
-}
-
-struct SimplePointRawReader {
-    input: Box<dyn Read>,
-    bps: BytesPerSample,
-    mapping_conf: String,
-}
-
-fn to_point(normalized_input: Vec<f64>, mapping_conf: &str) -> Result<SimplePoint, Error> {
-    let has_color =
-        mapping_conf.contains('r') || mapping_conf.contains('g') || mapping_conf.contains('b');
-
-    let mut result = SimplePoint {
-        x: 0,
-        y: 0,
-        r: if has_color { 0 } else { 255 },
-        g: if has_color { 0 } else { 255 },
-        b: if has_color { 0 } else { 255 },
-        is_blank: false,
-    };
-
-    for (i, c) in mapping_conf.chars().enumerate() {
-        match c {
-            'x' => result.x = (normalized_input[i] * i16::max_value() as f64) as i16,
-            'X' => result.x = (-normalized_input[i] * i16::max_value() as f64) as i16,
-            'y' => result.y = (normalized_input[i] * i16::max_value() as f64) as i16,
-            'Y' => result.y = (-normalized_input[i] * i16::max_value() as f64) as i16,
-            'r' => result.r = ((normalized_input[i] + 1.0) / 2.0 * u8::max_value() as f64) as u8,
-            'g' => result.g = ((normalized_input[i] + 1.0) / 2.0 * u8::max_value() as f64) as u8,
-            'b' => result.b = ((normalized_input[i] + 1.0) / 2.0 * u8::max_value() as f64) as u8,
-            'l' => result.is_blank = normalized_input[i] < 0.0,
-            '_' => {}
-            _ => return Err(Error::InvalidChannel(c)),
-        }
-    }
-
-    Ok(result)
-}
-
-impl Iterator for SimplePointRawReader {
-    type Item = Result<SimplePoint, Error>;
-
-    fn next(&mut self) -> Option<Result<SimplePoint, Error>> {
-        let mut normalized_input: Vec<_> = vec![];
-
-        for _ in 0..self.mapping_conf.len() {
-            let value = match self.bps {
-                BytesPerSample::OneByte => match self.input.read_i8() {
-                    Ok(data) => data as f64 / i8::max_value() as f64,
-                    Err(e) => match e.kind() {
-                        ErrorKind::UnexpectedEof => return None,
-                        _ => return Some(Err(Error::IoError(e))),
-                    },
-                },
-                BytesPerSample::TwoBytes => match self.input.read_i16::<LittleEndian>() {
-                    Ok(data) => data as f64 / i16::max_value() as f64,
-                    Err(e) => match e.kind() {
-                        ErrorKind::UnexpectedEof => return None,
-                        _ => return Some(Err(Error::IoError(e))),
-                    },
-                },
-                BytesPerSample::FourBytes => match self.input.read_i32::<LittleEndian>() {
-                    Ok(data) => data as f64 / i32::max_value() as f64,
-                    Err(e) => match e.kind() {
-                        ErrorKind::UnexpectedEof => return None,
-                        _ => return Some(Err(Error::IoError(e))),
-                    },
-                },
-            };
-
-            normalized_input.push(value);
-        }
-
-        Some(to_point(normalized_input, &self.mapping_conf))
-    }
-}
-
-struct SimplePointHoundReader {
-    hound: WavReader<Box<Read>>,
-    mapping_conf: String,
-}
-
-impl Iterator for SimplePointHoundReader {
-    type Item = Result<SimplePoint, Error>;
-
-    fn next(&mut self) -> Option<Result<SimplePoint, Error>> {
-        let mut normalized_input: Vec<_> = vec![];
-
-        for _ in 0..self.mapping_conf.len() {
-            let value = match self.hound.samples::<i32>().next() {
-                Some(Err(e)) => return Some(Err(Error::HoundError(e))),
-                Some(Ok(sample)) => match self.hound.spec().bits_per_sample {
-                    8 => sample as f64 / i8::max_value() as f64,
-                    16 => sample as f64 / i16::max_value() as f64,
-                    32 => sample as f64 / i32::max_value() as f64,
-                    _ => return Some(Err(Error::UnsupportedBitsPerSample)),
-                },
-                None => return None,
-            };
-            normalized_input.push(value);
-        }
-
-        Some(to_point(normalized_input, &self.mapping_conf))
-    }
-}
-
 struct Options {
-    input: Box<dyn Read>,
+    input: Input,
     output: Box<dyn Write>,
     raw_pcm: bool,
-    fps: f64,
+    fps: Fps,
     bits_per_sample: u32,
     sample_rate: u32,
     mapping_conf: String,
+    stats: Option<Arc<Stats>>,
 }
 
 fn get_options<'a>() -> Result<Options, Error> {
@@ -226,6 +116,13 @@ A 5.1 channel file that controls the axis with rear channels and includes the bl
                 .required(true)
                 .index(1),
         )
+        .arg(
+            Arg::with_name("STATS")
+                .long("stats")
+                .help("Reports runtime statistics on STDERR about once per second: frames, points and samples per second and the time of the decode (reading and mapping the samples of a frame) and write stages (mean/p99/max). Give json to print every report as one JSON line.")
+                .takes_value(true)
+                .min_values(0),
+        )
         .arg(
             Arg::with_name("FILES")
                 .multiple(true)
@@ -245,7 +142,7 @@ A 5.1 channel file that controls the axis with rear channels and includes the bl
 
     let bits_per_sample: u32 = matches.value_of("BPS").unwrap().parse()?;
 
-    let fps: f64 = matches.value_of("FPS").unwrap().parse()?;
+    let fps = Fps::parse(matches.value_of("FPS").unwrap()).ok_or(Error::InvalidFps)?;
 
     let files: Vec<&str> = match matches.values_of("FILES") {
         Some(files) => files.collect(),
@@ -262,10 +159,7 @@ A 5.1 channel file that controls the axis with rear channels and includes the bl
         _ => (None, None),
     };
 
-    let input: Box<dyn Read> = match file_in {
-        Some(filename) => Box::new(File::open(filename)?),
-        None => Box::new(io::stdin()),
-    };
+    let input = Input::open_or_stdin(file_in)?;
 
     let output: Box<dyn Write> = match file_out {
         Some(filename) => Box::new(File::create(filename)?),
@@ -274,6 +168,15 @@ A 5.1 channel file that controls the axis with rear channels and includes the bl
 
     let mapping_conf = matches.value_of("CHANNELS").unwrap().to_string();
 
+    let stats = if matches.is_present("STATS") {
+        match StatsFormat::parse(matches.value_of("STATS")) {
+            Some(format) => Some(Stats::start(format)),
+            None => return Err(Error::UnknownStatsFormat),
+        }
+    } else {
+        None
+    };
+
     eprintln!("Input:           {}", file_in.unwrap_or("STDIN"));
     eprintln!("Output:          {}", file_out.unwrap_or("STDOUT"));
     eprintln!("Mapping:         {}", mapping_conf);
@@ -286,6 +189,7 @@ A 5.1 channel file that controls the axis with rear channels and includes the bl
         bits_per_sample,
         mapping_conf,
         fps,
+        stats,
     })
 }
 
@@ -295,69 +199,85 @@ fn main() -> Result<(), Error> {
 
     let options = get_options()?;
 
-    let reader: Box<dyn Iterator<Item = Result<SimplePoint, Error>>> = if options.raw_pcm {
+    let mapping = Mapping::new(&options.mapping_conf).map_err(Error::InvalidChannel)?;
+
+    let (reader, sample_rate) = if options.raw_pcm {
         eprintln!(
             "Raw PCM:       Yes - {}bit @ {}Hz",
             options.bits_per_sample, options.sample_rate
         );
 
-        let bps = match options.bits_per_sample {
-            8 => BytesPerSample::OneByte,
-            16 => BytesPerSample::TwoBytes,
-            32 => BytesPerSample::FourBytes,
+        let encoding = match options.bits_per_sample {
+            8 => Encoding::Signed8,
+            16 => Encoding::Signed16,
+            32 => Encoding::Signed32,
             _ => return Err(Error::UnsupportedBitsPerSample),
         };
 
-        Box::new(SimplePointRawReader {
-            input: options.input,
-            bps,
-            mapping_conf: options.mapping_conf,
-        })
+        (
+            SimplePointReader::new(Box::new(options.input), encoding, mapping),
+            options.sample_rate,
+        )
     } else {
         eprintln!("Raw PCM:         No");
 
-        let reader = Box::new(SimplePointHoundReader {
-            hound: WavReader::new(options.input)?,
-            mapping_conf: options.mapping_conf,
-        });
+        let hound = WavReader::new(options.input)?;
+        let spec = hound.spec();
+
+        eprintln!("Sample rate:     {}", spec.sample_rate);
+        eprintln!("Bits per sample: {}", spec.bits_per_sample);
 
-        eprintln!("Sample rate:     {}", reader.hound.spec().sample_rate);
-        eprintln!("Bits per sample: {}", reader.hound.spec().bits_per_sample);
+        if spec.sample_format != SampleFormat::Int {
+            return Err(Error::UnsupportedSampleFormat);
+        }
 
-        reader
+        let encoding = match spec.bits_per_sample {
+            8 => Encoding::Unsigned8,
+            16 => Encoding::Signed16,
+            32 => Encoding::Signed32,
+            _ => return Err(Error::UnsupportedBitsPerSample),
+        };
+
+        // hound has parsed the header, the sample data follows directly
+        // limit it to the data chunk, chunks after it are not samples
+        let data_size = hound.len() as u64 * encoding.bytes() as u64;
+        let input: Box<dyn BufRead> = Box::new(hound.into_inner().take(data_size));
+
+        (
+            SimplePointReader::new(input, encoding, mapping),
+            spec.sample_rate,
+        )
     };
 
     let mut writer = AnimationStreamWriter::new(options.output);
 
-    let mut current_time = 0.0;
-    let time_per_sample = 1.0 / options.sample_rate as f64;
-    let time_per_frame = 1.0 / options.fps;
-    let mut next_frame = time_per_frame;
-
-    let mut points: Vec<SimplePoint> = vec![];
-    for result in reader {
-        points.push(result?);
-        current_time = current_time + time_per_sample;
-        if current_time > next_frame {
-            writer.write_frame(&Frame::new(
-                points.clone(),
-                Some(String::from("")),
-                Some(String::from("")),
-            ))?;
-            points.clear();
-            next_frame = next_frame + time_per_frame;
-        }
-    }
+    let stats = options.stats.as_deref();
+    let mut timer = StageTimer::new(stats);
+
+    for points in FrameCutter::new(reader, options.fps, sample_rate) {
+        let points = points?;
+        timer.lap(Stage::Decode);
 
-    if !points.is_empty() {
+        let len = points.len();
         writer.write_frame(&Frame::new(
-            points.clone(),
+            points,
             Some(String::from("")),
             Some(String::from("")),
         ))?;
+
+        timer.lap(Stage::Write);
+        if let Some(stats) = stats {
+            // every sample becomes a point
+            stats.frame(len);
+            stats.samples(len);
+        }
     }
 
     writer.finalize()?;
 
+    if let Some(stats) = stats {
+        stats.report();
+    }
+
     Ok(())
 }
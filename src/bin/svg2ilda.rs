@@ -1,54 +1,73 @@
 use chrono::Local;
 use clap::{App, Arg};
 use ilda::SimplePoint;
-use ilda::animation::{Frame, Animation};
-use ilda::writer::IldaWriter;
-use lyon_geom::cubic_bezier::Flattened;
-use lyon_geom::euclid::Point2D;
-use lyon_geom::CubicBezierSegment;
-use std::fs::File;
-use std::io::{self, Error as IoError, Read, Write};
-use std::num::ParseFloatError;
-use usvg::{
-    Color, Error as UsvgError, Fill, NodeKind, Paint, Path, PathSegment, Stroke, Transform, Tree,
-    Visibility,
-};
-
-struct Point {
-    x: f64,
-    y: f64,
-    color: Color,
-    blank: bool,
+use ilda::animation::{AnimationStreamWriter, Frame};
+use ilda::IldaError;
+use ilda_tools::flatten::{ilda_scale, to_ilda_points};
+use ilda_tools::frame_sink::{FrameSink, Output};
+use ilda_tools::input::Input;
+use ilda_tools::render::FrameSender;
+use ilda_tools::stats::{Format as StatsFormat, Stage, StageTimer, Stats};
+use std::collections::BTreeMap;
+use std::f64::consts::PI;
+use std::fs::{self, File};
+use std::io::{self, Error as IoError};
+use std::num::{ParseFloatError, ParseIntError};
+use std::path::{Path as FilePath, PathBuf};
+use std::sync::mpsc;
+use std::sync::{Arc, Mutex};
+use std::thread;
+use usvg::{Error as UsvgError, NodeKind, Tree, ViewBox};
+
+// Settings that apply to every svg
+struct Conversion {
+    invert: bool,
+    optimize: bool,
+    tolerance: f64,
+    // maximum amount of points, if any
+    budget: Option<usize>,
+    // extra points at line ends and at a turn back
+    dwell: usize,
+    // smallest turn in radians that gets dwell points
+    corner: f64,
+    // maximum distance between lit points
+    spacing: Option<f64>,
+    // runtime statistics, if any
+    stats: Option<Arc<Stats>>,
 }
 
 struct Options {
-    input: Box<dyn Read>,
-    output: Box<dyn Write>,
+    // svg files in frame order, STDIN if empty
+    inputs: Vec<PathBuf>,
+    output: Output,
     name: String,
     company_name: String,
-    invert: bool,
-    tolerance: f64,
+    jobs: usize,
+    conversion: Arc<Conversion>,
 }
 
-const DEFAULT_POINT: Point = Point {
-    x: 0.0,
-    y: 0.0,
-    color: Color {
-        red: 255,
-        green: 255,
-        blue: 255,
-    },
-    blank: true,
-};
+// One converted svg
+struct Converted {
+    points: Vec<SimplePoint>,
+    // the tolerance that was needed to fit the point budget
+    fitted_tolerance: Option<f64>,
+    // blanked travel before and after optimizing
+    travel: Option<(f64, f64)>,
+}
 
 #[derive(Debug)]
 enum Error {
     UsvgError(UsvgError),
     ParseFloatError(ParseFloatError),
+    ParseIntError(ParseIntError),
     IoError(IoError),
+    IldaError(IldaError),
     FailedToInferInputFile,
+    RenderWithOutputFile,
     InvalidSvg,
     SvgTooComplexForIlda,
+    PointBudgetTooSmall,
+    UnknownStatsFormat,
 }
 
 impl From<UsvgError> for Error {
@@ -63,6 +82,18 @@ impl From<ParseFloatError> for Error {
     }
 }
 
+impl From<ParseIntError> for Error {
+    fn from(error: ParseIntError) -> Self {
+        Error::ParseIntError(error)
+    }
+}
+
+impl From<IldaError> for Error {
+    fn from(error: IldaError) -> Self {
+        Error::IldaError(error)
+    }
+}
+
 impl From<IoError> for Error {
     fn from(error: IoError) -> Self {
         Error::IoError(error)
@@ -83,6 +114,47 @@ fn get_options<'a>() -> Result<Options, Error> {
                 .help("Tolerance when plotting curves. Lower values (above 0) will produce smoother curves.")
                 .takes_value(true),
         )
+        .arg(
+            Arg::with_name("POINTS")
+                .short("p")
+                .long("points")
+                .help("Maximum amount of points. If the output would have more points, the tolerance is raised and straight runs of points are merged until it fits.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("PPS")
+                .long("pps")
+                .help("Points per second of the projector. Limits the amount of points to what the projector can draw at the given fps.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("FPS")
+                .short("f")
+                .long("fps")
+                .default_value("20.0")
+                .help("Frames per second the output should be drawn with. This value is ignored unless pps is given.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("DWELL")
+                .long("dwell")
+                .default_value("0")
+                .help("Extra points where lines start and end and at corners, so the galvos can settle instead of overshooting. Line ends and a full turn back get this many points, smaller turns proportionally fewer.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("CORNER")
+                .long("corner")
+                .default_value("45")
+                .help("Smallest turn in degrees that counts as a corner and gets dwell points.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("SPACING")
+                .long("spacing")
+                .help("Maximum distance between lit points in ILDA coordinates (-32768~32767). Longer lines get evenly spaced points, so the galvos draw them at an even speed.")
+                .takes_value(true),
+        )
         .arg(
             Arg::with_name("NAME")
                 .required(false)
@@ -108,19 +180,47 @@ Please note that the company name in the header can only hold 8 bytes and will b
                 .long("invert")
                 .help("Inverts colors. Particular usefull with black and white files."),
         )
+        .arg(
+            Arg::with_name("OPTIMIZE")
+                .short("o")
+                .long("optimize")
+                .help("Reorders and reverses subpaths to shorten the blanked travel between them. This leaves more of each frame for drawing at a given pps."),
+        )
+        .arg(
+            Arg::with_name("JOBS")
+                .short("j")
+                .long("jobs")
+                .help("Converts svg files on this many worker threads. Uses all cores if not given.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("STATS")
+                .long("stats")
+                .help("Reports runtime statistics on STDERR about once per second: frames and points per second, frames over the point budget, the conversion queue and the time of the decode (parsing the svg), map (flattening), render (optimizing and scanning) and write stages (mean/p99/max). Give json to print every report as one JSON line.")
+                .takes_value(true)
+                .min_values(0),
+        )
+        .arg(
+            Arg::with_name("ILDA2WAV")
+                .long("ilda2wav")
+                .help("Renders the frames in this process like ilda2wav with the given arguments instead of writing ILDA, e.g. --ilda2wav \"xyrgb -r -d\". The arguments are split at whitespace and can only name an output file. This saves encoding and decoding the frames.")
+                .takes_value(true)
+                .allow_hyphen_values(true),
+        )
         .arg(
             Arg::with_name("FILES")
                 .multiple(true)
                 .required(false)
                 .help(
-                    r#"Specify 0~2 filenames.
+                    r#"Specify input and output filenames.
 0 filename: Read the input from STDIN and write the output to STDOUT
 1 filename with .svg extension: Read the input from the given file and write the output to STDOUT
 1 filename with .ild extension: Read the input from STDIN and write the output to the given file
 2 filenames: Read the input from the first file and write the output to the second file
+
+Several svg files or directories: Every svg becomes one frame of the animation, in the given order. The svg files of a directory are taken in the order of their names. If the last filename has an .ild extension, the output is written to it, otherwise to STDOUT.
                 "#,
                 )
-                .max_values(2)
                 .index(1),
         )
         .get_matches();
@@ -130,24 +230,56 @@ Please note that the company name in the header can only hold 8 bytes and will b
         None => vec![],
     };
 
-    let (file_in, file_out) = match files.len() {
-        1 => match &files[0].to_lowercase()[files[0].len() - 4..] {
-            ".ild" => (None, Some(files[0])),
-            ".svg" => (Some(files[0]), None),
-            _ => return Err(Error::FailedToInferInputFile),
-        },
-        2 => (Some(files[0]), Some(files[1])),
-        _ => (None, None),
+    let is_input = |file: &str| FilePath::new(file).is_dir() || has_extension(file, "svg");
+
+    let (files_in, file_out) = match files.len() {
+        0 => (vec![], None),
+        1 if has_extension(files[0], "ild") => (vec![], Some(files[0])),
+        1 if is_input(files[0]) => (files, None),
+        1 => return Err(Error::FailedToInferInputFile),
+        2 if !is_input(files[1]) => (vec![files[0]], Some(files[1])),
+        n if has_extension(files[n - 1], "ild") => (files[..n - 1].to_vec(), Some(files[n - 1])),
+        _ => (files, None),
+    };
+
+    let mut inputs = vec![];
+    for file in &files_in {
+        let path = PathBuf::from(file);
+        if path.is_dir() {
+            let mut svgs: Vec<PathBuf> = fs::read_dir(&path)?
+                .map(|entry| entry.map(|entry| entry.path()))
+                .collect::<Result<_, _>>()?;
+            svgs.retain(|svg| svg.to_str().map_or(false, |svg| has_extension(svg, "svg")));
+            svgs.sort();
+            inputs.extend(svgs);
+        } else {
+            inputs.push(path);
+        }
+    }
+
+    let output = match (matches.value_of("ILDA2WAV"), file_out) {
+        (Some(_), Some(_)) => return Err(Error::RenderWithOutputFile),
+        (Some(args), None) => Output::Render(String::from(args)),
+        (None, Some(filename)) => Output::Ilda(Box::new(File::create(filename)?)),
+        (None, None) => Output::Ilda(Box::new(io::stdout())),
     };
 
-    let input: Box<dyn Read> = match file_in {
-        Some(filename) => Box::new(File::open(filename)?),
-        None => Box::new(io::stdin()),
+    let dwell: usize = matches.value_of("DWELL").unwrap().parse()?;
+
+    let corner = matches
+        .value_of("CORNER")
+        .unwrap()
+        .parse::<f64>()?
+        .to_radians();
+
+    let spacing = match matches.value_of("SPACING") {
+        Some(spacing) => Some(spacing.parse::<f64>()?).filter(|spacing| *spacing > 0.0),
+        None => None,
     };
 
-    let output: Box<dyn Write> = match file_out {
-        Some(filename) => Box::new(File::create(filename)?),
-        None => Box::new(io::stdout()),
+    let jobs = match matches.value_of("JOBS") {
+        Some(jobs) => jobs.parse::<usize>()?.max(1),
+        None => thread::available_parallelism().map_or(1, |jobs| jobs.get()),
     };
 
     let name = matches
@@ -158,167 +290,583 @@ Please note that the company name in the header can only hold 8 bytes and will b
 
     let invert = matches.is_present("INVERT");
 
+    let optimize = matches.is_present("OPTIMIZE");
+
+    let stats = if matches.is_present("STATS") {
+        match StatsFormat::parse(matches.value_of("STATS")) {
+            Some(format) => Some(Stats::start(format)),
+            None => return Err(Error::UnknownStatsFormat),
+        }
+    } else {
+        None
+    };
+
     let tolerance = matches.value_of("TOLERANCE").unwrap().parse()?;
 
-    eprintln!("Input:         {}", file_in.unwrap_or("STDIN"));
-    eprintln!("Output:        {}", file_in.unwrap_or("STDOUT"));
+    let points = match matches.value_of("POINTS") {
+        Some(points) => Some(points.parse::<f64>()?),
+        None => None,
+    };
+
+    let pps = match matches.value_of("PPS") {
+        Some(pps) => {
+            let fps: f64 = matches.value_of("FPS").unwrap().parse()?;
+            Some(pps.parse::<f64>()? / fps)
+        }
+        None => None,
+    };
+
+    let budget = match (points, pps) {
+        (Some(points), Some(pps)) => Some(points.min(pps)),
+        (points, pps) => points.or(pps),
+    }
+    .map(|budget| (budget as usize).min(u16::max_value() as usize));
+
+    match inputs.len() {
+        0 => eprintln!("Input:         STDIN"),
+        1 => eprintln!("Input:         {}", inputs[0].display()),
+        n => eprintln!("Input:         {} files", n),
+    }
+    match &output {
+        Output::Render(args) => eprintln!("Output:        ilda2wav {}", args),
+        Output::Ilda(_) => eprintln!("Output:        {}", file_out.unwrap_or("STDOUT")),
+    }
     eprintln!("Name:          {} / {}", &name[0..8], &company_name[0..8]);
     eprintln!("Invert colors: {}", if invert { "Yes" } else { "No" });
     eprintln!("Tolerance:     {}", tolerance);
+    eprintln!("Optimize:      {}", if optimize { "Yes" } else { "No" });
+    if let Some(budget) = budget {
+        eprintln!("Point budget:  {}", budget);
+    }
+    if dwell > 0 {
+        eprintln!("Dwell:         {}", dwell);
+    }
+    if let Some(spacing) = spacing {
+        eprintln!("Spacing:       {}", spacing);
+    }
+    if inputs.len() > 1 {
+        eprintln!("Jobs:          {}", jobs);
+    }
 
     Ok(Options {
-        input,
+        inputs,
         output,
         name,
-        invert,
         company_name,
-        tolerance,
+        jobs,
+        conversion: Arc::new(Conversion {
+            invert,
+            optimize,
+            tolerance,
+            budget,
+            dwell,
+            corner,
+            spacing,
+            stats,
+        }),
     })
 }
 
-fn collect_points_from_node(
-    node: &usvg::Node,
-    points: &mut Vec<Point>,
-    transform: &Transform,
-    options: &Options,
+fn has_extension(file: &str, extension: &str) -> bool {
+    FilePath::new(file)
+        .extension()
+        .and_then(|e| e.to_str())
+        .map_or(false, |e| e.eq_ignore_ascii_case(extension))
+}
+
+// Angle between the line from a to b and the line from b to c. 0 is straight on, PI turns back.
+fn turn_angle(a: &SimplePoint, b: &SimplePoint, c: &SimplePoint) -> f64 {
+    let (x1, y1) = (b.x as f64 - a.x as f64, b.y as f64 - a.y as f64);
+    let (x2, y2) = (c.x as f64 - b.x as f64, c.y as f64 - b.y as f64);
+
+    let lengths = (x1 * x1 + y1 * y1).sqrt() * (x2 * x2 + y2 * y2).sqrt();
+    if lengths == 0.0 {
+        return 0.0;
+    }
+
+    ((x1 * x2 + y1 * y2) / lengths).max(-1.0).min(1.0).acos()
+}
+
+// Passes on the points together with points that help the galvos to follow them:
+// - blanked copies where a line starts and ends, so the galvos settle while the laser is off
+// - copies of corner points, more for sharper turns
+// - evenly spaced points on lines that are longer than the spacing
+fn add_scan_points(
+    points: &[SimplePoint],
+    options: &Conversion,
+    mut push: impl FnMut(SimplePoint),
 ) {
-    match &*node.borrow() {
-        NodeKind::Svg(_) => {
-            for child in node.children() {
-                collect_points_from_node(&child, points, transform, options);
+    let lit = |i: usize| i < points.len() && !points[i].is_blank;
+
+    for (i, point) in points.iter().enumerate() {
+        if let Some(spacing) = options.spacing {
+            if i > 0 && !point.is_blank {
+                let from = &points[i - 1];
+                let (dx, dy) = (
+                    point.x as f64 - from.x as f64,
+                    point.y as f64 - from.y as f64,
+                );
+                let steps = ((dx * dx + dy * dy).sqrt() / spacing).ceil() as usize;
+                for step in 1..steps {
+                    let t = step as f64 / steps as f64;
+                    push(SimplePoint {
+                        x: (from.x as f64 + dx * t).round() as i16,
+                        y: (from.y as f64 + dy * t).round() as i16,
+                        ..point.clone()
+                    });
+                }
             }
         }
-        NodeKind::Path(path) => {
-            if path.visibility != Visibility::Visible {
-                return;
-            }
 
-            let mut path_transform = transform.clone();
-            path_transform.append(&path.transform);
-            let path_transform = path_transform;
-
-            let mut color = if let Path {
-                stroke:
-                    Some(Stroke {
-                        paint: Paint::Color(color),
-                        ..
-                    }),
-                ..
-            } = path
-            {
-                *color
-            } else if let Path {
-                fill:
-                    Some(Fill {
-                        paint: Paint::Color(color),
-                        ..
-                    }),
-                ..
-            } = path
-            {
-                *color
+        push(point.clone());
+
+        let dwell = if point.is_blank {
+            // start of a line
+            if lit(i + 1) {
+                options.dwell
+            } else {
+                0
+            }
+        } else if !lit(i + 1) {
+            // end of a line
+            options.dwell
+        } else if i > 0 {
+            let turn = turn_angle(&points[i - 1], point, &points[i + 1]);
+            if turn >= options.corner {
+                (options.dwell as f64 * turn / PI).ceil() as usize
             } else {
-                Color::white()
-            };
-
-            if options.invert {
-                color = Color {
-                    red: 255 - color.red,
-                    green: 255 - color.green,
-                    blue: 255 - color.blue,
+                0
+            }
+        } else {
+            0
+        };
+
+        for _ in 0..dwell {
+            push(SimplePoint {
+                is_blank: point.is_blank || !lit(i + 1),
+                ..point.clone()
+            });
+        }
+    }
+}
+
+fn scan_points(points: &[SimplePoint], options: &Conversion) -> Vec<SimplePoint> {
+    let mut scanned = Vec::with_capacity(points.len());
+    add_scan_points(points, options, |point| scanned.push(point));
+    scanned
+}
+
+fn scan_point_count(points: &[SimplePoint], options: &Conversion) -> usize {
+    let mut count = 0;
+    add_scan_points(points, options, |_| count += 1);
+    count
+}
+
+// Tolerance search when fitting a point budget
+const MAX_TOLERANCE_DOUBLINGS: usize = 32;
+const TOLERANCE_BISECTIONS: usize = 8;
+
+fn same_color(a: &SimplePoint, b: &SimplePoint) -> bool {
+    a.r == b.r && a.g == b.g && a.b == b.b
+}
+
+// Distance of p to the line segment from a to b.
+fn segment_distance(p: &SimplePoint, a: &SimplePoint, b: &SimplePoint) -> f64 {
+    let (px, py) = (p.x as f64, p.y as f64);
+    let (ax, ay) = (a.x as f64, a.y as f64);
+    let (dx, dy) = (b.x as f64 - ax, b.y as f64 - ay);
+
+    let length = dx * dx + dy * dy;
+    let t = if length > 0.0 {
+        (((px - ax) * dx + (py - ay) * dy) / length)
+            .max(0.0)
+            .min(1.0)
+    } else {
+        0.0
+    };
+
+    ((ax + t * dx - px).powi(2) + (ay + t * dy - py).powi(2)).sqrt()
+}
+
+// Drops points that are closer than max_deviation to the line between the points that are kept
+// (Ramer-Douglas-Peucker). Only runs of lit points with the same color are merged, so blanking and colors
+// stay where they are.
+fn simplify(points: Vec<SimplePoint>, max_deviation: f64) -> Vec<SimplePoint> {
+    let mut keep = vec![true; points.len()];
+    let mut stack = vec![];
+
+    let mut start = 0;
+    while start + 1 < points.len() {
+        // a run starts at the point the beam comes from
+        let mut end = start + 1;
+        while end < points.len()
+            && !points[end].is_blank
+            && same_color(&points[end], &points[start + 1])
+        {
+            end += 1;
+        }
+
+        for i in start + 1..end - 1 {
+            keep[i] = false;
+        }
+
+        stack.push((start, end - 1));
+        while let Some((first, last)) = stack.pop() {
+            let farthest = (first + 1..last)
+                .map(|i| {
+                    (
+                        i,
+                        segment_distance(&points[i], &points[first], &points[last]),
+                    )
+                })
+                .fold(None, |max: Option<(usize, f64)>, (i, d)| match max {
+                    Some((_, max_d)) if max_d >= d => max,
+                    _ => Some((i, d)),
+                });
+
+            if let Some((i, d)) = farthest {
+                if d > max_deviation {
+                    keep[i] = true;
+                    stack.push((first, i));
+                    stack.push((i, last));
                 }
             }
+        }
 
-            let mut first_index = points.len();
-            for segment in &path.segments {
-                match segment {
-                    PathSegment::MoveTo { x, y } => {
-                        let coord = path_transform.apply(*x, *y);
-                        points.push(Point {
-                            x: coord.0,
-                            y: coord.1,
-                            color,
-                            blank: true,
-                        })
-                    }
-                    PathSegment::LineTo { x, y } => {
-                        let coord = path_transform.apply(*x, *y);
-                        points.push(Point {
-                            x: coord.0,
-                            y: coord.1,
-                            color,
-                            blank: false,
-                        })
-                    }
-                    PathSegment::CurveTo {
-                        x,
-                        y,
-                        x1,
-                        y1,
-                        x2,
-                        y2,
-                    } => {
-                        let last = points.last().unwrap_or(&DEFAULT_POINT);
-                        let coord = path_transform.apply(*x, *y);
-                        let coord1 = path_transform.apply(*x1, *y1);
-                        let coord2 = path_transform.apply(*x2, *y2);
-
-                        let bezier = CubicBezierSegment {
-                            from: Point2D::new(last.x, last.y),
-                            to: Point2D::new(coord.0, coord.1),
-                            ctrl1: Point2D::new(coord1.0, coord1.1),
-                            ctrl2: Point2D::new(coord2.0, coord2.1),
-                        };
-
-                        for point in Flattened::new(bezier, options.tolerance) {
-                            points.push(Point {
-                                x: point.x,
-                                y: point.y,
-                                color,
-                                blank: false,
-                            })
+        start = if end - 1 > start { end - 1 } else { end };
+    }
+
+    points
+        .into_iter()
+        .zip(keep)
+        .filter_map(|(point, keep)| if keep { Some(point) } else { None })
+        .collect()
+}
+
+// Raises the tolerance until the points fit into the budget. Curves are flattened and straight runs are
+// merged with the same tolerance, so the points go to where the drawing is most detailed. The smallest
+// tolerance that fits is searched to use as much of the budget as possible.
+fn fit_point_budget(
+    root: &usvg::Node,
+    view_box: &ViewBox,
+    options: &Conversion,
+    budget: usize,
+) -> Result<(Vec<SimplePoint>, Option<f64>), Error> {
+    // dwell and spacing points are added later, but count as well
+    let fits = |points: &[SimplePoint]| scan_point_count(points, options) <= budget;
+
+    let points = to_ilda_points(root, view_box, options.invert, options.tolerance);
+    if fits(&points) {
+        return Ok((points, None));
+    }
+
+    let scale = ilda_scale(view_box);
+    let convert = |tolerance: f64| {
+        simplify(
+            to_ilda_points(root, view_box, options.invert, tolerance),
+            tolerance * scale,
+        )
+    };
+
+    // double the tolerance until it fits
+    let mut low = options.tolerance;
+    let mut high = low;
+    let mut points = convert(high);
+    let mut doublings = 0;
+    while !fits(&points) {
+        if doublings == MAX_TOLERANCE_DOUBLINGS {
+            return Err(Error::PointBudgetTooSmall);
+        }
+        low = high;
+        high *= 2.0;
+        points = convert(high);
+        doublings += 1;
+    }
+
+    // then narrow it down
+    for _ in 0..TOLERANCE_BISECTIONS {
+        let tolerance = (low + high) / 2.0;
+        let candidate = convert(tolerance);
+        if fits(&candidate) {
+            high = tolerance;
+            points = candidate;
+        } else {
+            low = tolerance;
+        }
+    }
+
+    Ok((points, Some(high)))
+}
+
+// Subpaths are reordered on a grid with about this many endpoints per cell
+const ENDPOINTS_PER_CELL: usize = 4;
+// 2-opt tries to reverse runs of up to this many subpaths
+const TWO_OPT_WINDOW: usize = 256;
+const TWO_OPT_PASSES: usize = 16;
+
+// Points that are drawn without blanking, entered by a blanked travel to the first point.
+// A reversed subpath is drawn from its last point to its first point.
+#[derive(Clone, Copy)]
+struct Subpath {
+    first: usize,
+    last: usize,
+    reversed: bool,
+}
+
+impl Subpath {
+    fn start(&self, points: &[SimplePoint]) -> (f64, f64) {
+        position(&points[if self.reversed { self.last } else { self.first }])
+    }
+
+    fn end(&self, points: &[SimplePoint]) -> (f64, f64) {
+        position(&points[if self.reversed { self.first } else { self.last }])
+    }
+}
+
+fn position(point: &SimplePoint) -> (f64, f64) {
+    (point.x as f64, point.y as f64)
+}
+
+fn distance(a: (f64, f64), b: (f64, f64)) -> f64 {
+    ((a.0 - b.0).powi(2) + (a.1 - b.1).powi(2)).sqrt()
+}
+
+// A new subpath starts at every blanked point.
+fn split_subpaths(points: &[SimplePoint]) -> Vec<Subpath> {
+    let mut subpaths: Vec<Subpath> = vec![];
+
+    for (i, point) in points.iter().enumerate() {
+        match subpaths.last_mut() {
+            Some(subpath) if !point.is_blank => subpath.last = i,
+            _ => subpaths.push(Subpath {
+                first: i,
+                last: i,
+                reversed: false,
+            }),
+        }
+    }
+
+    subpaths
+}
+
+// Blanked travel of one frame, including the travel back to the start, as the frame is drawn repeatedly.
+fn travel(points: &[SimplePoint], route: &[Subpath]) -> f64 {
+    route
+        .iter()
+        .zip(route.iter().cycle().skip(1))
+        .map(|(from, to)| distance(from.end(points), to.start(points)))
+        .sum()
+}
+
+// Both endpoints of every subpath, bucketed by position.
+struct EndpointGrid {
+    // subpath index and whether it is entered at its last point
+    cells: Vec<Vec<(usize, bool)>>,
+    columns: usize,
+    cell_size: f64,
+}
+
+impl EndpointGrid {
+    fn new(points: &[SimplePoint], subpaths: &[Subpath]) -> EndpointGrid {
+        let columns = ((subpaths.len() * 2 / ENDPOINTS_PER_CELL) as f64)
+            .sqrt()
+            .ceil()
+            .max(1.0) as usize;
+
+        let mut grid = EndpointGrid {
+            cells: vec![vec![]; columns * columns],
+            columns,
+            cell_size: 65536.0 / columns as f64,
+        };
+
+        for (i, subpath) in subpaths.iter().enumerate() {
+            let first = grid.cell(position(&points[subpath.first]));
+            let last = grid.cell(position(&points[subpath.last]));
+            grid.cells[first.1 * columns + first.0].push((i, false));
+            grid.cells[last.1 * columns + last.0].push((i, true));
+        }
+
+        grid
+    }
+
+    fn cell(&self, (x, y): (f64, f64)) -> (usize, usize) {
+        let column = |v: f64| (((v + 32768.0) / self.cell_size) as usize).min(self.columns - 1);
+        (column(x), column(y))
+    }
+
+    // The closest endpoint of a subpath that is not visited yet.
+    // Visited subpaths are removed from the cells on the way.
+    fn nearest(
+        &mut self,
+        from: (f64, f64),
+        points: &[SimplePoint],
+        subpaths: &[Subpath],
+        visited: &[bool],
+    ) -> Option<(usize, bool)> {
+        let (cx, cy) = self.cell(from);
+        let (cx, cy) = (cx as isize, cy as isize);
+        let columns = self.columns as isize;
+
+        let mut best = None;
+        let mut best_distance = std::f64::INFINITY;
+
+        for r in 0..columns {
+            for y in (cy - r).max(0)..=(cy + r).min(columns - 1) {
+                // only the border of the ring, the inside has been searched before
+                let step = if y == cy - r || y == cy + r {
+                    1
+                } else {
+                    2 * r.max(1)
+                };
+                let mut x = cx - r;
+                while x <= cx + r {
+                    if x >= 0 && x < columns {
+                        let cell = &mut self.cells[(y * columns + x) as usize];
+                        let mut i = 0;
+                        while i < cell.len() {
+                            let (subpath, reversed) = cell[i];
+                            if visited[subpath] {
+                                cell.swap_remove(i);
+                                continue;
+                            }
+                            let subpath_ref = &subpaths[subpath];
+                            let entry = if reversed {
+                                subpath_ref.last
+                            } else {
+                                subpath_ref.first
+                            };
+                            let d = distance(from, position(&points[entry]));
+                            if d < best_distance {
+                                best_distance = d;
+                                best = Some((subpath, reversed));
+                            }
+                            i += 1;
                         }
                     }
-                    PathSegment::ClosePath => {
-                        let first_in_path = points.get(first_index).unwrap_or(&DEFAULT_POINT);
-                        let coord = path_transform.apply(first_in_path.x, first_in_path.y);
-                        points.push(Point {
-                            x: coord.0,
-                            y: coord.1,
-                            color,
-                            blank: false,
-                        });
-                        first_index = points.len();
-                    }
+                    x += step;
                 }
             }
 
-            for child in node.children() {
-                collect_points_from_node(&child, points, &path_transform, options);
+            // anything in the next rings is at least this far away
+            if best_distance <= r as f64 * self.cell_size {
+                break;
             }
         }
-        NodeKind::Group(group) => {
-            let mut group_transform = transform.clone();
-            group_transform.append(&group.transform);
 
-            for child in node.children() {
-                collect_points_from_node(&child, points, &group_transform, options);
+        best
+    }
+}
+
+// Greedily continues with the closest subpath, in either direction.
+fn nearest_neighbour_route(points: &[SimplePoint], subpaths: &[Subpath]) -> Vec<Subpath> {
+    let mut grid = EndpointGrid::new(points, subpaths);
+    let mut visited = vec![false; subpaths.len()];
+    let mut route = Vec::with_capacity(subpaths.len());
+
+    let mut current = subpaths[0];
+    visited[0] = true;
+    route.push(current);
+
+    while let Some((next, reversed)) = grid.nearest(current.end(points), points, subpaths, &visited)
+    {
+        visited[next] = true;
+        current = Subpath {
+            reversed,
+            ..subpaths[next]
+        };
+        route.push(current);
+    }
+
+    route
+}
+
+// Reverses runs of subpaths (and their directions) as long as that shortens the travel.
+fn two_opt(points: &[SimplePoint], route: &mut [Subpath]) {
+    let n = route.len();
+
+    for _ in 0..TWO_OPT_PASSES {
+        let mut improved = false;
+
+        // the first subpath stays in place
+        for i in 1..n {
+            for j in i..n.min(i + TWO_OPT_WINDOW) {
+                let a = route[i - 1].end(points);
+                let b = route[i].start(points);
+                let c = route[j].end(points);
+                let d = route[(j + 1) % n].start(points);
+
+                if distance(a, c) + distance(b, d) < distance(a, b) + distance(c, d) - 1e-6 {
+                    route[i..=j].reverse();
+                    for subpath in &mut route[i..=j] {
+                        subpath.reversed = !subpath.reversed;
+                    }
+                    improved = true;
+                }
             }
         }
-        _ => {} // other elements not supported
+
+        if !improved {
+            break;
+        }
     }
 }
 
-fn main() -> Result<(), Error> {
-    eprintln!("svg2ilda - https://github.com/lukasjapan/ilda-tools");
-    eprintln!();
+// Reorders and reverses subpaths to shorten the blanked travel between them.
+// Returns the travel before and after.
+fn optimize_travel(points: Vec<SimplePoint>) -> (Vec<SimplePoint>, f64, f64) {
+    if points.is_empty() {
+        return (points, 0.0, 0.0);
+    }
+
+    let subpaths = split_subpaths(&points);
+    let before = travel(&points, &subpaths);
 
-    let mut options = get_options()?;
+    let mut route = nearest_neighbour_route(&points, &subpaths);
+    two_opt(&points, &mut route);
+    let after = travel(&points, &route);
 
-    let mut data: Vec<u8> = vec![];
-    options.input.read_to_end(&mut data)?;
+    // keep the document order if it is not worse
+    if after >= before {
+        return (points, before, before);
+    }
+
+    let mut optimized = Vec::with_capacity(points.len());
+    for subpath in route {
+        if subpath.reversed {
+            let mut point = points[subpath.last].clone();
+            point.is_blank = true;
+            optimized.push(point);
+
+            // a point has the color of the line that leads to it
+            for i in (subpath.first..subpath.last).rev() {
+                let color = &points[i + 1];
+                optimized.push(SimplePoint {
+                    r: color.r,
+                    g: color.g,
+                    b: color.b,
+                    is_blank: false,
+                    ..points[i].clone()
+                });
+            }
+        } else {
+            for i in subpath.first..=subpath.last {
+                let mut point = points[i].clone();
+                point.is_blank = i == subpath.first;
+                optimized.push(point);
+            }
+        }
+    }
+
+    (optimized, before, after)
+}
+
+fn convert(data: &[u8], options: &Conversion) -> Result<Converted, Error> {
+    let stats = options.stats.as_deref();
+    let mut timer = StageTimer::new(stats);
+
+    let tree = Tree::from_data(data, &usvg::Options::default())?;
+    timer.lap(Stage::Decode);
 
-    let tree = Tree::from_data(&data, &usvg::Options::default())?;
     let root = tree.root();
 
     let view_box = match &*root.borrow() {
@@ -326,61 +874,227 @@ fn main() -> Result<(), Error> {
         _ => return Err(Error::InvalidSvg), // This should never happen
     };
 
-    let mut points: Vec<Point> = vec![];
-    collect_points_from_node(&root, &mut points, &Transform::default(), &options);
+    let (points, fitted_tolerance) = match options.budget {
+        Some(budget) => fit_point_budget(&root, &view_box, options, budget)?,
+        None => (
+            to_ilda_points(&root, &view_box, options.invert, options.tolerance),
+            None,
+        ),
+    };
+    timer.lap(Stage::Map);
 
-    // Build a matrix that transform to ILDA coordinates
-    let dx = -view_box.rect.x - view_box.rect.width / 2.0;
-    let dy = -view_box.rect.y - view_box.rect.height / 2.0;
-    let s = i16::max_value() as f64 / view_box.rect.width.max(view_box.rect.height) * 2.0;
-    let mut t = Transform::default();
-    t.append(&mut Transform::new_scale(s, -s));
-    t.append(&mut Transform::new_translate(dx, dy));
+    let (points, travel) = if options.optimize {
+        let (points, before, after) = optimize_travel(points);
+        (points, Some((before, after)))
+    } else {
+        (points, None)
+    };
 
-    // do the actual transformation and filter out values that are outside the viewbox
-    let mut blank_next = false;
-    let points: Vec<_> = points
-        .into_iter()
-        .filter_map(|point| {
-            let (x, y) = t.apply(point.x, point.y);
-            // out of bound
-            if x.round() < i16::min_value() as f64
-                || x.round() > i16::max_value() as f64
-                || y.round() < i16::min_value() as f64
-                || y.round() > i16::max_value() as f64
-            {
-                blank_next = true;
-                None
-            } else {
-                Some(SimplePoint {
-                    x: x.round() as i16,
-                    y: y.round() as i16,
-                    r: point.color.red,
-                    g: point.color.green,
-                    b: point.color.green,
-                    is_blank: if blank_next {
-                        blank_next = false;
-                        true
-                    } else {
-                        point.blank
-                    },
-                })
-            }
+    let points = if options.dwell > 0 || options.spacing.is_some() {
+        scan_points(&points, options)
+    } else {
+        points
+    };
+
+    if points.len() > u16::max_value() as usize {
+        return Err(Error::SvgTooComplexForIlda);
+    }
+
+    timer.lap(Stage::Render);
+    // the tolerance had to be raised to fit the svg into the point budget
+    if let (Some(stats), Some(_)) = (stats, fitted_tolerance) {
+        stats.over_budget();
+    }
+
+    Ok(Converted {
+        points,
+        fitted_tolerance,
+        travel,
+    })
+}
+
+fn convert_file(path: &FilePath, options: &Conversion) -> Result<Converted, Error> {
+    convert(&Input::open(path)?.contents()?, options)
+}
+
+fn report(converted: &Converted) {
+    if let Some(tolerance) = converted.fitted_tolerance {
+        eprintln!("Tolerance:     {} (fitted to the point budget)", tolerance);
+    }
+    if let Some((before, after)) = converted.travel {
+        eprintln!("Travel:        {:.0} -> {:.0}", before, after);
+    }
+    eprintln!("Points:        {}", converted.points.len());
+}
+
+// Converts the files on worker threads and passes the results back in input order.
+// Only a few files per worker are in flight, so memory stays bounded at any amount of files.
+fn convert_parallel(
+    inputs: Vec<PathBuf>,
+    options: Arc<Conversion>,
+    jobs: usize,
+    mut write: impl FnMut(&FilePath, Converted) -> Result<(), Error>,
+) -> Result<(), Error> {
+    let (file_sender, file_receiver) = mpsc::channel::<(usize, PathBuf)>();
+    let file_receiver = Arc::new(Mutex::new(file_receiver));
+    let (result_sender, result_receiver) = mpsc::channel::<(usize, Result<Converted, Error>)>();
+
+    let workers: Vec<_> = (0..jobs.min(inputs.len()))
+        .map(|_| {
+            let files = file_receiver.clone();
+            let results = result_sender.clone();
+            let options = options.clone();
+
+            thread::spawn(move || loop {
+                let (index, path) = match files.lock().unwrap().recv() {
+                    Ok(file) => file,
+                    Err(_) => break,
+                };
+
+                if results
+                    .send((index, convert_file(&path, &options)))
+                    .is_err()
+                {
+                    break;
+                }
+            })
         })
         .collect();
 
-    let len = points.len();
-    if len > u16::max_value() as usize {
-        return Err(Error::SvgTooComplexForIlda);
+    drop(result_sender);
+
+    let mut files = inputs.iter().cloned().enumerate();
+    let mut pending = BTreeMap::new();
+    let mut sent = 0;
+    let mut written = 0;
+
+    let result = loop {
+        while sent - written < jobs * 2 {
+            match files.next() {
+                Some(file) => file_sender.send(file).expect("Worker thread panicked."),
+                None => break,
+            }
+            sent += 1;
+        }
+
+        if written == sent {
+            break Ok(());
+        }
+
+        let (index, converted) = result_receiver.recv().expect("Worker thread panicked.");
+        pending.insert(index, converted);
+
+        if let Err(e) = flush_pending(&inputs, &mut pending, &mut written, &mut write) {
+            break Err(e);
+        }
+
+        if let Some(stats) = &options.stats {
+            stats.queue(sent - written);
+        }
+    };
+
+    // workers stop once the files are gone
+    drop(file_sender);
+
+    for worker in workers {
+        worker.join().expect("Worker thread panicked.");
+    }
+
+    result
+}
+
+fn flush_pending(
+    inputs: &[PathBuf],
+    pending: &mut BTreeMap<usize, Result<Converted, Error>>,
+    written: &mut usize,
+    write: &mut impl FnMut(&FilePath, Converted) -> Result<(), Error>,
+) -> Result<(), Error> {
+    while let Some(converted) = pending.remove(written) {
+        write(&inputs[*written], converted?)?;
+        *written += 1;
     }
 
-    eprintln!("Points:        {}", len);
+    Ok(())
+}
+
+fn main() -> Result<(), Error> {
+    eprintln!("svg2ilda - https://github.com/lukasjapan/ilda-tools");
+    eprintln!();
+
+    let options = get_options()?;
+
+    let mut sink = match options.output {
+        Output::Ilda(file) => FrameSink::Ilda(AnimationStreamWriter::new(file)),
+        Output::Render(args) => FrameSink::Render(FrameSender::spawn(&args)),
+    };
+    let name = options.name;
+    let company_name = options.company_name;
+
+    let stats = options.conversion.stats.clone();
+
+    let mut write_frame = |points: Vec<SimplePoint>| -> Result<(), Error> {
+        let mut timer = StageTimer::new(stats.as_deref());
+        let len = points.len();
+
+        sink.write_frame::<Error>(Frame::new(
+            points,
+            Some(name.clone()),
+            Some(company_name.clone()),
+        ))?;
+
+        timer.lap(Stage::Write);
+        if let Some(stats) = &stats {
+            stats.frame(len);
+        }
+        Ok(())
+    };
+
+    match options.inputs.len() {
+        0 => {
+            let converted = convert(&Input::stdin().contents()?, &options.conversion)?;
+            report(&converted);
+            write_frame(converted.points)?;
+        }
+        1 => {
+            let converted = convert_file(&options.inputs[0], &options.conversion)?;
+            report(&converted);
+            write_frame(converted.points)?;
+        }
+        _ => {
+            let mut frames = 0;
+            let mut points = 0;
+            // blanked travel of all frames, before and after optimizing
+            let mut travel: Option<(f64, f64)> = None;
+
+            convert_parallel(
+                options.inputs,
+                options.conversion,
+                options.jobs,
+                |_, converted| {
+                    frames += 1;
+                    points += converted.points.len();
+                    if let Some((before, after)) = converted.travel {
+                        let (total_before, total_after) = travel.unwrap_or((0.0, 0.0));
+                        travel = Some((total_before + before, total_after + after));
+                    }
+                    write_frame(converted.points)?;
+                    Ok(())
+                },
+            )?;
+
+            eprintln!("Frames:        {}", frames);
+            eprintln!("Points:        {}", points);
+            if let Some((before, after)) = travel {
+                eprintln!("Travel:        {:.0} -> {:.0}", before, after);
+            }
+        }
+    }
 
-    let frame = Frame::new(points, Some(options.name), Some(options.company_name));
-    let frames = vec![frame];
-    let animation = Animation::new(frames);
+    sink.finish::<Error>()?;
 
-    animation.write(options.output);
+    if let Some(stats) = stats {
+        stats.report();
+    }
 
     Ok(())
 }
@@ -1,20 +1,39 @@
 use byteorder::{LittleEndian, ReadBytesExt};
 use clap::{App, Arg};
+use cpal::traits::{DeviceTrait, HostTrait, StreamTrait};
+use cpal::SampleFormat;
 use hound::{Error as HoundError, WavReader};
 use ilda::animation::{AnimationStreamWriter, Frame};
 use ilda::{IldaError, SimplePoint};
-use rustfft::algorithm::Radix4;
-use rustfft::num_complex::Complex;
-use rustfft::FFT;
+use ilda_tools::frame_sink::{FrameSink, Output};
+use ilda_tools::input::Input;
+use ilda_tools::render::FrameSender;
+use ilda_tools::ring_buffer::{ring_buffer, Consumer};
+use ilda_tools::spectrum::{BinTable, Spectrum, WindowFunction};
+use ilda_tools::stats::{Format as StatsFormat, Stage, StageTimer, Stats};
+use std::cell::RefCell;
+use std::fmt::Display;
 use std::fs::File;
-use std::io::{self, Error as IoError, ErrorKind, Read, Write};
+use std::io::{self, BufWriter, Error as IoError, ErrorKind, Read, Write};
 use std::num::{ParseFloatError, ParseIntError};
+use std::rc::Rc;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Arc;
+use std::thread;
+use std::time::{Duration, Instant};
 
 #[derive(Debug)]
 enum Error {
     IoError(IoError),
     FailedToInferInputFile,
     UnsupportedBitsPerSample,
+    UnknownWindowFunction,
+    UnknownStatsFormat,
+    InvalidWindowSize,
+    LiveInputNotRaw,
+    RenderWithOutputFile,
+    DeviceNotFound,
+    DeviceError(String),
     ParseFloatError(ParseFloatError),
     ParseIntError(ParseIntError),
     IldaError(IldaError),
@@ -51,6 +70,10 @@ impl From<HoundError> for Error {
     }
 }
 
+fn device_error<E: Display>(error: E) -> Error {
+    Error::DeviceError(error.to_string())
+}
+
 enum BytesPerSample {
     OneByte,
     TwoBytes,
@@ -58,114 +81,342 @@ enum BytesPerSample {
 }
 
 struct Options {
-    input: Box<dyn Read>,
-    output: Box<dyn Write>,
+    input: Input,
+    output: Output,
     raw_pcm: bool,
+    live: bool,
+    // capture device name, Some(None) for the default device
+    device: Option<Option<String>>,
+    window_size: usize,
     fps: f64,
     bits_per_sample: u16,
     bins: u16,
     sample_rate: u32,
+    window_function: WindowFunction,
+    stats: Option<Arc<Stats>>,
+}
+
+// Reads the samples of one analysis window per frame, averaged over all channels.
+trait WindowReader {
+    // Fills window with the next samples, returns false at the end of the input.
+    fn read_window(&mut self, window: &mut [f64]) -> Result<bool, Error>;
+}
+
+// Continuous input, averaged over all channels.
+trait SampleSource {
+    // Fills samples, waits for the input if needed. Returns false at the end of the input.
+    fn read_samples(&mut self, samples: &mut [f64]) -> Result<bool, Error>;
 }
 
 struct SamplesHoundReader {
-    hound: WavReader<Box<dyn Read>>,
-    sample_window: usize,
+    hound: WavReader<Input>,
+    divisor: f64,
     sample_duration: usize,
 }
 
 struct SamplesRawReader {
-    input: Box<dyn Read>,
+    input: Input,
     bps: BytesPerSample,
     channels: u16,
-    sample_window: usize,
     sample_duration: usize,
 }
 
-impl Iterator for SamplesHoundReader {
-    type Item = Result<Vec<Complex<f64>>, Error>;
-
-    fn next(&mut self) -> Option<Result<Vec<Complex<f64>>, Error>> {
-        let mut result = Vec::with_capacity(self.sample_window);
-
+impl SampleSource for SamplesHoundReader {
+    fn read_samples(&mut self, samples: &mut [f64]) -> Result<bool, Error> {
         let channels = self.hound.spec().channels as usize;
 
-        let divisor = match self.hound.spec().bits_per_sample {
-            8 => i8::max_value() as f64,
-            16 => i16::max_value() as f64,
-            32 => i32::max_value() as f64,
-            _ => return Some(Err(Error::UnsupportedBitsPerSample)),
-        };
-
-        // collect samples
-        for _ in 0..self.sample_window {
-            let mut samples = Vec::with_capacity(channels as usize);
+        for avg in samples.iter_mut() {
+            let mut sum = 0.0;
             for _ in 0..channels {
-                let sample = match self.hound.samples::<i32>().next() {
-                    Some(Err(e)) => return Some(Err(Error::HoundError(e))),
-                    Some(Ok(sample)) => sample as f64 / divisor,
-                    None => return None,
+                sum += match self.hound.samples::<i32>().next() {
+                    Some(Err(e)) => return Err(Error::HoundError(e)),
+                    Some(Ok(sample)) => sample as f64 / self.divisor,
+                    None => return Ok(false),
                 };
-                samples.push(sample);
             }
-            let avg = samples.iter().sum::<f64>() / samples.len() as f64;
-            result.push(Complex::new(avg, 0.0));
+            *avg = sum / channels as f64;
+        }
+
+        Ok(true)
+    }
+}
+
+// Windows up to the length of a frame. Longer windows overlap and are read through a LiveReader.
+impl WindowReader for SamplesHoundReader {
+    fn read_window(&mut self, window: &mut [f64]) -> Result<bool, Error> {
+        if !self.read_samples(window)? {
+            return Ok(false);
         }
 
         // discard the remaining samples
-        for _ in 0..((self.sample_duration - self.sample_window) * channels) {
+        let channels = self.hound.spec().channels as usize;
+        for _ in 0..(self.sample_duration.saturating_sub(window.len()) * channels) {
             self.hound.samples::<i32>().next();
         }
 
-        Some(Ok(result))
+        Ok(true)
     }
 }
 
-impl Iterator for SamplesRawReader {
-    type Item = Result<Vec<Complex<f64>>, Error>;
-
-    fn next(&mut self) -> Option<Result<Vec<Complex<f64>>, Error>> {
-        let mut result = Vec::with_capacity(self.sample_window);
-
-        // collect samples
-        for _ in 0..self.sample_window {
-            let mut samples = Vec::with_capacity(self.channels as usize);
+impl SampleSource for SamplesRawReader {
+    fn read_samples(&mut self, samples: &mut [f64]) -> Result<bool, Error> {
+        for avg in samples.iter_mut() {
+            let mut sum = 0.0;
             for _ in 0..self.channels {
                 let sample = match self.bps {
-                    BytesPerSample::OneByte => match self.input.read_i8() {
-                        Ok(data) => data as f64 / i8::max_value() as f64,
-                        Err(e) => match e.kind() {
-                            ErrorKind::UnexpectedEof => return None,
-                            _ => return Some(Err(Error::IoError(e))),
-                        },
-                    },
-                    BytesPerSample::TwoBytes => match self.input.read_i16::<LittleEndian>() {
-                        Ok(data) => data as f64 / i16::max_value() as f64,
-                        Err(e) => match e.kind() {
-                            ErrorKind::UnexpectedEof => return None,
-                            _ => return Some(Err(Error::IoError(e))),
-                        },
-                    },
-                    BytesPerSample::FourBytes => match self.input.read_i32::<LittleEndian>() {
-                        Ok(data) => data as f64 / i32::max_value() as f64,
-                        Err(e) => match e.kind() {
-                            ErrorKind::UnexpectedEof => return None,
-                            _ => return Some(Err(Error::IoError(e))),
-                        },
+                    BytesPerSample::OneByte => self
+                        .input
+                        .read_i8()
+                        .map(|data| data as f64 / i8::max_value() as f64),
+                    BytesPerSample::TwoBytes => self
+                        .input
+                        .read_i16::<LittleEndian>()
+                        .map(|data| data as f64 / i16::max_value() as f64),
+                    BytesPerSample::FourBytes => self
+                        .input
+                        .read_i32::<LittleEndian>()
+                        .map(|data| data as f64 / i32::max_value() as f64),
+                };
+                sum += match sample {
+                    Ok(sample) => sample,
+                    Err(e) => match e.kind() {
+                        ErrorKind::UnexpectedEof => return Ok(false),
+                        _ => return Err(Error::IoError(e)),
                     },
                 };
-                samples.push(sample);
             }
+            *avg = sum / self.channels as f64;
+        }
 
-            let avg = samples.iter().sum::<f64>() / samples.len() as f64;
-            result.push(Complex::new(avg, 0.0));
+        Ok(true)
+    }
+}
+
+// Windows up to the length of a frame. Longer windows overlap and are read through a LiveReader.
+impl WindowReader for SamplesRawReader {
+    fn read_window(&mut self, window: &mut [f64]) -> Result<bool, Error> {
+        if !self.read_samples(window)? {
+            return Ok(false);
         }
 
         // discard the remaining samples
-        //        for _ in 0..((self.sample_duration - self.sample_window) * self.channels) {
-        //            self.hound.samples::<i32>().next()
-        //        }
+        let bytes = match self.bps {
+            BytesPerSample::OneByte => 1,
+            BytesPerSample::TwoBytes => 2,
+            BytesPerSample::FourBytes => 4,
+        };
+        let remaining = self.sample_duration.saturating_sub(window.len()) * self.channels as usize;
+        io::copy(
+            &mut self.input.by_ref().take((remaining * bytes) as u64),
+            &mut io::sink(),
+        )?;
+
+        Ok(true)
+    }
+}
+
+// Captures samples from an audio device.
+// The device callback pushes into a ring buffer that holds a few frames worth of samples. If the analysis
+// falls behind by more than a frame, the oldest samples are skipped, so the latency stays bounded.
+struct DeviceSource {
+    consumer: Consumer<f32>,
+    channels: usize,
+    sample_rate: u32,
+    captured: Vec<f32>,
+    skipped: u64,
+    reported: u64,
+    next_report: Instant,
+    // set by the error callback of the stream
+    failed: Arc<AtomicBool>,
+    // capturing stops when the stream is dropped
+    _stream: cpal::Stream,
+}
+
+// Longest wait for the samples of a frame before the capture stream counts as stopped
+const CAPTURE_TIMEOUT: Duration = Duration::from_secs(2);
+
+impl DeviceSource {
+    fn new(name: Option<&str>, fps: f64, window_size: usize) -> Result<DeviceSource, Error> {
+        let host = cpal::default_host();
+
+        let device = match name {
+            Some(name) => host
+                .input_devices()
+                .map_err(device_error)?
+                .find(|device| device.name().map(|n| n == name).unwrap_or(false)),
+            None => host.default_input_device(),
+        }
+        .ok_or(Error::DeviceNotFound)?;
+
+        let supported = device.default_input_config().map_err(device_error)?;
+        let config = supported.config();
+        let channels = config.channels as usize;
+        let sample_rate = config.sample_rate.0;
+
+        let frame = (sample_rate as f64 / fps) as usize;
+        let (mut producer, consumer) = ring_buffer((frame * 4 + window_size) * channels);
+
+        let mut converted: Vec<f32> = vec![];
+        let mut capture = move |data: &[f32]| {
+            // if the buffer is full, the reader is far behind and skips ahead anyway
+            producer.push_slice(data);
+        };
+
+        let failed = Arc::new(AtomicBool::new(false));
+        let on_error = |failed: Arc<AtomicBool>| {
+            move |e: cpal::StreamError| {
+                eprintln!("Audio device error: {}", e);
+                failed.store(true, Ordering::Release);
+            }
+        };
+
+        let stream = match supported.sample_format() {
+            SampleFormat::F32 => device.build_input_stream(
+                &config,
+                move |data: &[f32], _: &cpal::InputCallbackInfo| capture(data),
+                on_error(failed.clone()),
+            ),
+            SampleFormat::I16 => device.build_input_stream(
+                &config,
+                move |data: &[i16], _: &cpal::InputCallbackInfo| {
+                    converted.clear();
+                    converted.extend(data.iter().map(cpal::Sample::to_f32));
+                    capture(&converted)
+                },
+                on_error(failed.clone()),
+            ),
+            SampleFormat::U16 => device.build_input_stream(
+                &config,
+                move |data: &[u16], _: &cpal::InputCallbackInfo| {
+                    converted.clear();
+                    converted.extend(data.iter().map(cpal::Sample::to_f32));
+                    capture(&converted)
+                },
+                on_error(failed.clone()),
+            ),
+        }
+        .map_err(device_error)?;
+
+        stream.play().map_err(device_error)?;
+
+        Ok(DeviceSource {
+            consumer,
+            channels,
+            sample_rate,
+            captured: vec![],
+            skipped: 0,
+            reported: 0,
+            next_report: Instant::now(),
+            failed,
+            _stream: stream,
+        })
+    }
+}
+
+impl SampleSource for DeviceSource {
+    fn read_samples(&mut self, samples: &mut [f64]) -> Result<bool, Error> {
+        let needed = samples.len() * self.channels;
+
+        let waiting = Instant::now();
+        while self.consumer.len() < needed {
+            // the samples will never arrive if the stream failed or stopped delivering
+            if self.failed.load(Ordering::Acquire) || self.consumer.is_closed() {
+                return Err(device_error("The capture stream failed."));
+            }
+            if waiting.elapsed() > CAPTURE_TIMEOUT {
+                return Err(device_error("The capture stream stopped."));
+            }
+            thread::sleep(Duration::from_millis(1));
+        }
+
+        // more than one read behind, skip the oldest samples (whole sample frames only)
+        let excess = (self.consumer.len() - needed) / self.channels * self.channels;
+        if excess > needed {
+            self.captured.resize(excess, 0.0);
+            self.consumer.pop_slice(&mut self.captured);
+            self.skipped += (excess / self.channels) as u64;
+        }
+
+        let now = Instant::now();
+        if now >= self.next_report && self.skipped != self.reported {
+            self.next_report = now + Duration::from_secs(1);
+            self.reported = self.skipped;
+            eprintln!("Skipped samples to keep up: {}", self.skipped);
+        }
+
+        self.captured.resize(needed, 0.0);
+        self.consumer.pop_slice(&mut self.captured);
+
+        for (avg, frame) in samples
+            .iter_mut()
+            .zip(self.captured.chunks_exact(self.channels))
+        {
+            *avg = frame.iter().map(|s| *s as f64).sum::<f64>() / self.channels as f64;
+        }
+
+        Ok(true)
+    }
+}
+
+// Analyzes continuous input in overlapping windows.
+// Every read takes the samples of one frame from the source and returns the latest window, so a frame is
+// ready as soon as its samples arrived. Windows overlap if they are longer than a frame.
+struct LiveReader {
+    source: Box<dyn SampleSource>,
+    // the latest samples, oldest at pos
+    history: Vec<f64>,
+    pos: usize,
+    frame: Vec<f64>,
+}
+
+impl LiveReader {
+    fn new(
+        source: Box<dyn SampleSource>,
+        sample_duration: usize,
+        window_size: usize,
+    ) -> LiveReader {
+        LiveReader {
+            source,
+            history: vec![0.0; window_size],
+            pos: 0,
+            frame: vec![0.0; sample_duration.max(1)],
+        }
+    }
+}
+
+impl WindowReader for LiveReader {
+    fn read_window(&mut self, window: &mut [f64]) -> Result<bool, Error> {
+        if !self.source.read_samples(&mut self.frame)? {
+            return Ok(false);
+        }
+
+        let len = self.history.len();
+
+        // older samples would be overwritten anyway
+        let new = &self.frame[self.frame.len().saturating_sub(len)..];
+        for sample in new {
+            self.history[self.pos] = *sample;
+            self.pos = (self.pos + 1) % len;
+        }
+
+        window[..len - self.pos].copy_from_slice(&self.history[self.pos..]);
+        window[len - self.pos..].copy_from_slice(&self.history[..self.pos]);
+
+        Ok(true)
+    }
+}
 
-        Some(Ok(result))
+// Write handle that can be shared, so the output can be flushed after every frame in live mode.
+#[derive(Clone)]
+struct SharedWriter(Rc<RefCell<BufWriter<Box<dyn Write>>>>);
+
+impl Write for SharedWriter {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.0.borrow_mut().write(buf)
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        self.0.borrow_mut().flush()
     }
 }
 
@@ -212,6 +463,50 @@ fn get_options<'a>() -> Result<Options, Error> {
                 .help("Amount of equalizer bins for the visualization. Higher values lead to more complex but more detailed output.")
                 .takes_value(true),
         )
+        .arg(
+            Arg::with_name("LIVE")
+                .short("l")
+                .long("live")
+                .help("Analyzes the input continuously. Every frame is computed from the latest samples as soon as they arrived and is written right away. Analysis windows overlap if they are longer than a frame. Needs raw pcm input or an audio device.")
+        )
+        .arg(
+            Arg::with_name("DEVICE")
+                .short("d")
+                .long("device")
+                .help("Captures the input from an audio device in live mode. Uses the default device if no name is given.")
+                .takes_value(true)
+                .min_values(0),
+        )
+        .arg(
+            Arg::with_name("WINDOWSIZE")
+                .short("n")
+                .long("window-size")
+                .default_value("256")
+                .help("Amount of samples per analysis window. Larger windows give a finer frequency resolution. Must be even.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("WINDOW")
+                .short("w")
+                .long("window")
+                .default_value("rectangular")
+                .help("Window function that is applied to the samples before the frequency analysis. One of rectangular, hann, hamming or blackman. The latter ones reduce the leakage between frequencies.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("STATS")
+                .long("stats")
+                .help("Reports runtime statistics on STDERR about once per second: frames, points and samples per second, frames over budget in live mode and the time of the decode (reading samples), map (frequency analysis and bins), render (building the frame) and write stages (mean/p99/max). Give json to print every report as one JSON line.")
+                .takes_value(true)
+                .min_values(0),
+        )
+        .arg(
+            Arg::with_name("ILDA2WAV")
+                .long("ilda2wav")
+                .help("Renders the frames in this process like ilda2wav with the given arguments instead of writing ILDA, e.g. --ilda2wav \"xyl -d\". The arguments are split at whitespace and can only name an output file. This saves encoding and decoding the frames.")
+                .takes_value(true)
+                .allow_hyphen_values(true),
+        )
         .arg(
             Arg::with_name("FILES")
                 .multiple(true)
@@ -226,6 +521,24 @@ fn get_options<'a>() -> Result<Options, Error> {
 
     let raw_pcm = matches.is_present("RAW");
 
+    let device = if matches.is_present("DEVICE") {
+        Some(matches.value_of("DEVICE").map(String::from))
+    } else {
+        None
+    };
+
+    let live = matches.is_present("LIVE") || device.is_some();
+
+    if live && !raw_pcm && device.is_none() {
+        return Err(Error::LiveInputNotRaw);
+    }
+
+    let window_size: usize = matches.value_of("WINDOWSIZE").unwrap().parse()?;
+
+    if window_size < 2 || window_size % 2 != 0 {
+        return Err(Error::InvalidWindowSize);
+    }
+
     let sample_rate: u32 = matches.value_of("SAMPLERATE").unwrap().parse()?;
 
     let bits_per_sample: u16 = matches.value_of("BPS").unwrap().parse()?;
@@ -234,6 +547,23 @@ fn get_options<'a>() -> Result<Options, Error> {
 
     let fps: f64 = matches.value_of("FPS").unwrap().parse()?;
 
+    let window_function = match matches.value_of("WINDOW").unwrap() {
+        "rectangular" => WindowFunction::Rectangular,
+        "hann" => WindowFunction::Hann,
+        "hamming" => WindowFunction::Hamming,
+        "blackman" => WindowFunction::Blackman,
+        _ => return Err(Error::UnknownWindowFunction),
+    };
+
+    let stats = if matches.is_present("STATS") {
+        match StatsFormat::parse(matches.value_of("STATS")) {
+            Some(format) => Some(Stats::start(format)),
+            None => return Err(Error::UnknownStatsFormat),
+        }
+    } else {
+        None
+    };
+
     let files: Vec<&str> = match matches.values_of("FILES") {
         Some(files) => files.collect(),
         None => vec![],
@@ -249,27 +579,40 @@ fn get_options<'a>() -> Result<Options, Error> {
         _ => (None, None),
     };
 
-    let input: Box<dyn Read> = match file_in {
-        Some(filename) => Box::new(File::open(filename)?),
-        None => Box::new(io::stdin()),
-    };
+    let input = Input::open_or_stdin(file_in)?;
 
-    let output: Box<dyn Write> = match file_out {
-        Some(filename) => Box::new(File::create(filename)?),
-        None => Box::new(io::stdout()),
+    let output = match (matches.value_of("ILDA2WAV"), file_out) {
+        (Some(_), Some(_)) => return Err(Error::RenderWithOutputFile),
+        (Some(args), None) => Output::Render(String::from(args)),
+        (None, Some(filename)) => Output::Ilda(Box::new(File::create(filename)?)),
+        (None, None) => Output::Ilda(Box::new(io::stdout())),
     };
 
-    eprintln!("Input:           {}", file_in.unwrap_or("STDIN"));
-    eprintln!("Output:          {}", file_out.unwrap_or("STDOUT"));
+    match &device {
+        Some(name) => eprintln!(
+            "Input:           {} (audio device)",
+            name.as_ref().map_or("default", String::as_str)
+        ),
+        None => eprintln!("Input:           {}", file_in.unwrap_or("STDIN")),
+    }
+    match &output {
+        Output::Render(args) => eprintln!("Output:          ilda2wav {}", args),
+        Output::Ilda(_) => eprintln!("Output:          {}", file_out.unwrap_or("STDOUT")),
+    }
 
     Ok(Options {
         input,
         output,
         sample_rate,
         raw_pcm,
+        live,
+        device,
+        window_size,
         bits_per_sample,
         bins,
         fps,
+        window_function,
+        stats,
     })
 }
 
@@ -282,7 +625,7 @@ impl FrequencyWaves {
         FrequencyWaves { reverse: false }
     }
 
-    fn bins_to_frame(&mut self, bins: Vec<f64>) -> Frame {
+    fn bins_to_frame(&mut self, bins: &[f64]) -> Frame {
         let len = bins.len() as f64;
         let points: Vec<_> = bins
             .iter()
@@ -307,38 +650,30 @@ impl FrequencyWaves {
     }
 }
 
-fn get_value(samples: &Vec<Complex<f64>>, from_index: f64, to_index: f64) -> f64 {
-    let from_full = from_index.ceil();
-    let to_full = to_index.floor();
-    let first_fraction = from_full - from_index;
-    let last_fraction = to_index - to_full;
-    let from_full = from_full as usize;
-    let to_full = to_full as usize;
-
-    let mut sum = 0.0;
-    sum = sum + first_fraction * samples[from_full - 1].norm_sqr().sqrt();
-    if from_full < to_full {
-        for i in from_full..to_full {
-            sum = sum + samples[i].norm_sqr().sqrt();
-        }
-    } else {
-        for i in to_full..from_full {
-            sum = sum - samples[i].norm_sqr().sqrt();
-        }
-    }
-    sum = sum + last_fraction * samples[to_full].norm_sqr().sqrt();
-    (sum / (to_index - from_index))
-}
-
 fn main() -> Result<(), Error> {
     eprintln!("wav2ilda - https://github.com/lukasjapan/ilda-tools");
     eprintln!();
     let mut options = get_options()?;
 
-    let sample_window = 256;
-    let sample_duration = (options.sample_rate as f64 / options.fps) as usize;
+    let sample_window = options.window_size;
 
-    let reader: Box<dyn Iterator<Item = Result<Vec<Complex<f64>>, Error>>> = if options.raw_pcm {
+    let mut reader: Box<dyn WindowReader> = if let Some(name) = &options.device {
+        let source = DeviceSource::new(
+            name.as_ref().map(String::as_str),
+            options.fps,
+            sample_window,
+        )?;
+
+        options.sample_rate = source.sample_rate;
+        options.bits_per_sample = 32;
+
+        let sample_duration = (options.sample_rate as f64 / options.fps) as usize;
+        Box::new(LiveReader::new(
+            Box::new(source),
+            sample_duration,
+            sample_window,
+        ))
+    } else if options.raw_pcm {
         eprintln!("Raw PCM:       Yes");
 
         let bps = match options.bits_per_sample {
@@ -348,13 +683,24 @@ fn main() -> Result<(), Error> {
             _ => return Err(Error::UnsupportedBitsPerSample),
         };
 
-        Box::new(SamplesRawReader {
+        let sample_duration = (options.sample_rate as f64 / options.fps) as usize;
+        let reader = SamplesRawReader {
             input: options.input,
             bps,
             channels: 2,
-            sample_window,
             sample_duration,
-        })
+        };
+
+        // windows longer than a frame overlap, every frame still moves on by sample_duration
+        if options.live || sample_window > sample_duration {
+            Box::new(LiveReader::new(
+                Box::new(reader),
+                sample_duration,
+                sample_window,
+            ))
+        } else {
+            Box::new(reader)
+        }
     } else {
         eprintln!("Raw PCM:         No");
 
@@ -365,52 +711,97 @@ fn main() -> Result<(), Error> {
             32 => i32::max_value() as f64,
             _ => return Err(Error::UnsupportedBitsPerSample),
         };
-        let reader = Box::new(SamplesHoundReader {
+
+        options.sample_rate = hound.spec().sample_rate;
+        options.bits_per_sample = hound.spec().bits_per_sample;
+
+        let sample_duration = (options.sample_rate as f64 / options.fps) as usize;
+        let reader = SamplesHoundReader {
             hound,
-            sample_window,
+            divisor,
             sample_duration,
-        });
-
-        options.sample_rate = reader.hound.spec().sample_rate;
-        options.bits_per_sample = reader.hound.spec().bits_per_sample;
+        };
 
-        reader
+        if sample_window > sample_duration {
+            Box::new(LiveReader::new(
+                Box::new(reader),
+                sample_duration,
+                sample_window,
+            ))
+        } else {
+            Box::new(reader)
+        }
     };
 
     eprintln!("Sample rate:     {}", options.sample_rate);
     eprintln!("Bits per sample: {}", options.bits_per_sample);
+    eprintln!(
+        "Live:            {}",
+        if options.live { "Yes" } else { "No" }
+    );
+
+    let mut spectrum = Spectrum::new(sample_window, options.window_function);
+    let mut window = vec![0.0; sample_window];
+
+    let mut bin_table = BinTable::new(sample_window, options.sample_rate, options.bins);
+    let mut bins = Vec::with_capacity(options.bins as usize);
+
+    // only an ILDA stream is flushed in live mode, a renderer gets every frame right away
+    let mut output = None;
+    let mut sink = match options.output {
+        Output::Ilda(file) => {
+            let shared = SharedWriter(Rc::new(RefCell::new(BufWriter::new(file))));
+            output = Some(shared.clone());
+            FrameSink::Ilda(AnimationStreamWriter::new(shared))
+        }
+        Output::Render(args) => FrameSink::Render(FrameSender::spawn(&args)),
+    };
 
-    let fft = Radix4::new(sample_window, false);
-    let mut output = vec![Complex::new(0.0, 0.0); sample_window];
+    let mut vis = FrequencyWaves::new();
 
-    let mut writer = AnimationStreamWriter::new(options.output);
+    let stats = options.stats.as_deref();
+    let sample_duration = (options.sample_rate as f64 / options.fps) as usize;
+    let frame_time = Duration::from_secs_f64(1.0 / options.fps);
+    let mut timer = StageTimer::new(stats);
 
-    // display 20 - 20kHz range
-    let from_index = (sample_window as f64 * 100.0 / options.sample_rate as f64).max(1.0);
-    let to_index = sample_window as f64 * (20000.0 / options.sample_rate as f64).min(0.5);
+    while reader.read_window(&mut window)? {
+        timer.lap(Stage::Decode);
 
-    let log_space_from = from_index.log2();
-    let log_space_step = (to_index.log2() - log_space_from) / options.bins as f64;
+        let magnitudes = spectrum.process(&window);
 
-    let mut vis = FrequencyWaves::new();
+        bins.clear();
+        bin_table.process(magnitudes, &mut bins);
+        let mut busy = timer.lap(Stage::Map);
 
-    for result in reader {
-        let mut samples = result?;
-        fft.process(&mut samples, &mut output);
+        let frame = vis.bins_to_frame(&bins);
+        let points = frame.get_points().len();
+        busy += timer.lap(Stage::Render);
 
-        let bins: Vec<_> = (0..options.bins)
-            .map(|i| {
-                let from_index = (2.0 as f64).powf(log_space_from + i as f64 * log_space_step);
-                let to_index =
-                    (2.0 as f64).powf(log_space_from + (i as f64 + 1.0) * log_space_step);
-                get_value(&samples, from_index, to_index)
-            })
-            .collect();
+        sink.write_frame::<Error>(frame)?;
 
-        writer.write_frame(&vis.bins_to_frame(bins))?;
+        if let (true, Some(output)) = (options.live, &mut output) {
+            output.flush()?;
+        }
+        busy += timer.lap(Stage::Write);
+
+        if let Some(stats) = stats {
+            stats.frame(points);
+            stats.samples(sample_duration);
+            // a live frame has to be done before the samples of the next one are in
+            if options.live && busy > frame_time {
+                stats.over_budget();
+            }
+        }
+    }
+
+    sink.finish::<Error>()?;
+    if let Some(output) = &mut output {
+        output.flush()?;
     }
 
-    writer.finalize()?;
+    if let Some(stats) = stats {
+        stats.report();
+    }
 
     Ok(())
 }
@@ -0,0 +1,215 @@
+use ilda::SimplePoint;
+use lyon_geom::cubic_bezier::Flattened;
+use lyon_geom::euclid::Point2D;
+use lyon_geom::CubicBezierSegment;
+use usvg::{
+    Color, Fill, NodeKind, Paint, Path, PathSegment, Stroke, Transform, ViewBox, Visibility,
+};
+
+pub struct Point {
+    pub x: f64,
+    pub y: f64,
+    pub color: Color,
+    pub blank: bool,
+}
+
+pub const DEFAULT_POINT: Point = Point {
+    x: 0.0,
+    y: 0.0,
+    color: Color {
+        red: 255,
+        green: 255,
+        blue: 255,
+    },
+    blank: true,
+};
+
+pub fn collect_points_from_node(
+    node: &usvg::Node,
+    points: &mut Vec<Point>,
+    transform: &Transform,
+    invert: bool,
+    tolerance: f64,
+) {
+    match &*node.borrow() {
+        NodeKind::Svg(_) => {
+            for child in node.children() {
+                collect_points_from_node(&child, points, transform, invert, tolerance);
+            }
+        }
+        NodeKind::Path(path) => {
+            if path.visibility != Visibility::Visible {
+                return;
+            }
+
+            let mut path_transform = transform.clone();
+            path_transform.append(&path.transform);
+            let path_transform = path_transform;
+
+            let mut color = if let Path {
+                stroke:
+                    Some(Stroke {
+                        paint: Paint::Color(color),
+                        ..
+                    }),
+                ..
+            } = path
+            {
+                *color
+            } else if let Path {
+                fill:
+                    Some(Fill {
+                        paint: Paint::Color(color),
+                        ..
+                    }),
+                ..
+            } = path
+            {
+                *color
+            } else {
+                Color::white()
+            };
+
+            if invert {
+                color = Color {
+                    red: 255 - color.red,
+                    green: 255 - color.green,
+                    blue: 255 - color.blue,
+                }
+            }
+
+            let mut first_index = points.len();
+            for segment in &path.segments {
+                match segment {
+                    PathSegment::MoveTo { x, y } => {
+                        let coord = path_transform.apply(*x, *y);
+                        points.push(Point {
+                            x: coord.0,
+                            y: coord.1,
+                            color,
+                            blank: true,
+                        })
+                    }
+                    PathSegment::LineTo { x, y } => {
+                        let coord = path_transform.apply(*x, *y);
+                        points.push(Point {
+                            x: coord.0,
+                            y: coord.1,
+                            color,
+                            blank: false,
+                        })
+                    }
+                    PathSegment::CurveTo {
+                        x,
+                        y,
+                        x1,
+                        y1,
+                        x2,
+                        y2,
+                    } => {
+                        let last = points.last().unwrap_or(&DEFAULT_POINT);
+                        let coord = path_transform.apply(*x, *y);
+                        let coord1 = path_transform.apply(*x1, *y1);
+                        let coord2 = path_transform.apply(*x2, *y2);
+
+                        let bezier = CubicBezierSegment {
+                            from: Point2D::new(last.x, last.y),
+                            to: Point2D::new(coord.0, coord.1),
+                            ctrl1: Point2D::new(coord1.0, coord1.1),
+                            ctrl2: Point2D::new(coord2.0, coord2.1),
+                        };
+
+                        for point in Flattened::new(bezier, tolerance) {
+                            points.push(Point {
+                                x: point.x,
+                                y: point.y,
+                                color,
+                                blank: false,
+                            })
+                        }
+                    }
+                    PathSegment::ClosePath => {
+                        let first_in_path = points.get(first_index).unwrap_or(&DEFAULT_POINT);
+                        let coord = path_transform.apply(first_in_path.x, first_in_path.y);
+                        points.push(Point {
+                            x: coord.0,
+                            y: coord.1,
+                            color,
+                            blank: false,
+                        });
+                        first_index = points.len();
+                    }
+                }
+            }
+
+            for child in node.children() {
+                collect_points_from_node(&child, points, &path_transform, invert, tolerance);
+            }
+        }
+        NodeKind::Group(group) => {
+            let mut group_transform = transform.clone();
+            group_transform.append(&group.transform);
+
+            for child in node.children() {
+                collect_points_from_node(&child, points, &group_transform, invert, tolerance);
+            }
+        }
+        _ => {} // other elements not supported
+    }
+}
+
+// Scale from svg to ILDA coordinates
+pub fn ilda_scale(view_box: &ViewBox) -> f64 {
+    i16::max_value() as f64 / view_box.rect.width.max(view_box.rect.height) * 2.0
+}
+
+// Flattens all paths with the given tolerance and transforms them to ILDA coordinates.
+pub fn to_ilda_points(
+    root: &usvg::Node,
+    view_box: &ViewBox,
+    invert: bool,
+    tolerance: f64,
+) -> Vec<SimplePoint> {
+    let mut points: Vec<Point> = vec![];
+    collect_points_from_node(root, &mut points, &Transform::default(), invert, tolerance);
+
+    // Build a matrix that transform to ILDA coordinates
+    let dx = -view_box.rect.x - view_box.rect.width / 2.0;
+    let dy = -view_box.rect.y - view_box.rect.height / 2.0;
+    let s = ilda_scale(view_box);
+    let mut t = Transform::default();
+    t.append(&mut Transform::new_scale(s, -s));
+    t.append(&mut Transform::new_translate(dx, dy));
+
+    // do the actual transformation and filter out values that are outside the viewbox
+    let mut blank_next = false;
+    points
+        .into_iter()
+        .filter_map(|point| {
+            let (x, y) = t.apply(point.x, point.y);
+            // out of bound
+            if x.round() < i16::min_value() as f64
+                || x.round() > i16::max_value() as f64
+                || y.round() < i16::min_value() as f64
+                || y.round() > i16::max_value() as f64
+            {
+                blank_next = true;
+                None
+            } else {
+                Some(SimplePoint {
+                    x: x.round() as i16,
+                    y: y.round() as i16,
+                    r: point.color.red,
+                    g: point.color.green,
+                    b: point.color.blue,
+                    is_blank: if blank_next {
+                        blank_next = false;
+                        true
+                    } else {
+                        point.blank
+                    },
+                })
+            }
+        })
+        .collect()
+}
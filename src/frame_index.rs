@@ -0,0 +1,253 @@
+use super::input::Input;
+use ilda::animation::{Animation, Frame};
+use memmap::Mmap;
+use std::ffi::OsString;
+use std::fs::{self, File};
+use std::io::{self, BufWriter, ErrorKind, Read, Write};
+use std::ops::Range;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::time::UNIX_EPOCH;
+
+const HEADER_SIZE: usize = 32;
+
+// first bytes of a sidecar index file
+const SIDECAR_MAGIC: &[u8; 8] = b"ILDAIDX1";
+const SIDECAR_ENTRY_SIZE: usize = 20;
+
+// Where a frame is stored in an ILDA file.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct FrameEntry {
+    // offset of the frame header
+    pub offset: u64,
+    pub points: u16,
+    pub format: u8,
+    // offset of the header of the palette the colors of the frame refer to, None for the default palette
+    pub palette: Option<u64>,
+}
+
+// bytes per record of an ILDA section
+fn record_size(format: u8) -> Option<usize> {
+    match format {
+        0 => Some(8),
+        1 => Some(6),
+        2 => Some(3),
+        4 => Some(10),
+        5 => Some(8),
+        _ => None,
+    }
+}
+
+fn invalid(offset: usize, message: &str) -> io::Error {
+    io::Error::new(
+        ErrorKind::InvalidData,
+        format!("{} at byte {}", message, offset),
+    )
+}
+
+// Walks the section headers of an ILDA file, no points are decoded.
+// An incomplete section at the end of the data is left out.
+pub fn build(data: &[u8]) -> io::Result<Vec<FrameEntry>> {
+    let mut frames = vec![];
+    let mut palette = None;
+    let mut offset = 0;
+
+    while offset + HEADER_SIZE <= data.len() {
+        let header = &data[offset..offset + HEADER_SIZE];
+        if &header[..4] != b"ILDA" {
+            return Err(invalid(offset, "Missing ILDA header"));
+        }
+
+        let format = header[7];
+        let records = u16::from_be_bytes([header[24], header[25]]);
+
+        // a section without records ends the file
+        if records == 0 {
+            break;
+        }
+
+        let size = match record_size(format) {
+            Some(size) => size,
+            None => return Err(invalid(offset, "Unknown ILDA format")),
+        };
+        let end = offset + HEADER_SIZE + records as usize * size;
+        if end > data.len() {
+            break;
+        }
+
+        if format == 2 {
+            palette = Some(offset as u64);
+        } else {
+            frames.push(FrameEntry {
+                offset: offset as u64,
+                points: records,
+                format,
+                palette,
+            });
+        }
+
+        offset = end;
+    }
+
+    Ok(frames)
+}
+
+// length and modification time of the indexed file, a sidecar index is only used if both match
+fn stamp(path: &Path) -> Option<(u64, u64)> {
+    let metadata = fs::metadata(path).ok()?;
+    let modified = metadata.modified().ok()?.duration_since(UNIX_EPOCH).ok()?;
+    Some((metadata.len(), modified.as_nanos() as u64))
+}
+
+fn sidecar_path(path: &Path) -> PathBuf {
+    let mut sidecar = OsString::from(path);
+    sidecar.push(".idx");
+    PathBuf::from(sidecar)
+}
+
+fn u64_at(data: &[u8], offset: usize) -> u64 {
+    let mut bytes = [0; 8];
+    bytes.copy_from_slice(&data[offset..offset + 8]);
+    u64::from_le_bytes(bytes)
+}
+
+// Reads a sidecar index, None if it is missing, broken or outdated.
+fn load_sidecar(path: &Path, stamp: (u64, u64)) -> Option<Vec<FrameEntry>> {
+    let mut data = vec![];
+    File::open(path).ok()?.read_to_end(&mut data).ok()?;
+
+    if data.len() < 32 || &data[..8] != SIDECAR_MAGIC {
+        return None;
+    }
+    if (u64_at(&data, 8), u64_at(&data, 16)) != stamp {
+        return None;
+    }
+    let count = u64_at(&data, 24) as usize;
+    if data.len() != 32 + count * SIDECAR_ENTRY_SIZE {
+        return None;
+    }
+
+    let frames = data[32..]
+        .chunks_exact(SIDECAR_ENTRY_SIZE)
+        .map(|entry| FrameEntry {
+            offset: u64_at(entry, 0),
+            points: u16::from_le_bytes([entry[8], entry[9]]),
+            format: entry[10],
+            palette: if entry[11] != 0 {
+                Some(u64_at(entry, 12))
+            } else {
+                None
+            },
+        })
+        .collect();
+
+    Some(frames)
+}
+
+fn save_sidecar(path: &Path, stamp: (u64, u64), frames: &[FrameEntry]) -> io::Result<()> {
+    let mut writer = BufWriter::new(File::create(path)?);
+
+    writer.write_all(SIDECAR_MAGIC)?;
+    writer.write_all(&stamp.0.to_le_bytes())?;
+    writer.write_all(&stamp.1.to_le_bytes())?;
+    writer.write_all(&(frames.len() as u64).to_le_bytes())?;
+    for frame in frames {
+        writer.write_all(&frame.offset.to_le_bytes())?;
+        writer.write_all(&frame.points.to_le_bytes())?;
+        writer.write_all(&[frame.format, frame.palette.is_some() as u8])?;
+        writer.write_all(&frame.palette.unwrap_or(0).to_le_bytes())?;
+    }
+
+    writer.flush()
+}
+
+// A memory-mapped ILDA file with random access to its frames.
+pub struct IndexedAnimation {
+    data: Mmap,
+    frames: Vec<FrameEntry>,
+}
+
+impl IndexedAnimation {
+    // Indexes the mapped file at path.
+    // If cache is set, the index is kept in a sidecar file next to it (path.idx) and reused while the file
+    // does not change.
+    pub fn new(data: Mmap, path: &Path, cache: bool) -> io::Result<IndexedAnimation> {
+        let stamp = if cache { stamp(path) } else { None };
+        let sidecar = sidecar_path(path);
+
+        if let Some(frames) = stamp.and_then(|stamp| load_sidecar(&sidecar, stamp)) {
+            return Ok(IndexedAnimation { data, frames });
+        }
+
+        let frames = build(&data)?;
+
+        if let Some(stamp) = stamp {
+            // the index still works without its cache
+            if let Err(e) = save_sidecar(&sidecar, stamp, &frames) {
+                eprintln!("Failed to write {}: {}", sidecar.display(), e);
+            }
+        }
+
+        Ok(IndexedAnimation { data, frames })
+    }
+
+    pub fn len(&self) -> usize {
+        self.frames.len()
+    }
+
+    // bytes of the section whose header starts at offset
+    fn section(&self, offset: u64) -> Option<&[u8]> {
+        let offset = offset as usize;
+        let header = self.data.get(offset..offset + HEADER_SIZE)?;
+        let records = u16::from_be_bytes([header[24], header[25]]) as usize;
+        let size = record_size(header[7])?;
+        self.data.get(offset..offset + HEADER_SIZE + records * size)
+    }
+
+    // Decodes a single frame, together with the palette it refers to.
+    pub fn frame(&self, index: usize) -> Option<Frame> {
+        let entry = self.frames.get(index)?;
+        let palette = match entry.palette {
+            Some(offset) => self.section(offset)?,
+            None => &[],
+        };
+
+        let mut reader = palette.chain(self.section(entry.offset)?);
+        Animation::stream(&mut reader).next()
+    }
+
+    // Decodes the frames of range in order, stops at the first frame that fails to decode.
+    pub fn frames(self: Arc<Self>, range: Range<usize>) -> impl Iterator<Item = Frame> {
+        let end = range.end.min(self.len());
+        (range.start..end)
+            .map(move |index| self.frame(index))
+            .take_while(Option::is_some)
+            .flatten()
+    }
+}
+
+// Frames of an input. Indexed files can be decoded from any frame on, streams only from their start.
+pub enum Source {
+    Stream(Input),
+    Indexed(Arc<IndexedAnimation>),
+}
+
+impl Source {
+    // Opens the given file or STDIN if no file is given.
+    // Files are indexed if index is set and they can be mapped, cache keeps the index in a sidecar file.
+    pub fn open(path: Option<&str>, index: bool, cache: bool) -> io::Result<Source> {
+        let input = Input::open_or_stdin(path)?;
+
+        match path {
+            Some(path) if index => match input.into_map() {
+                Ok(map) => Ok(Source::Indexed(Arc::new(IndexedAnimation::new(
+                    map,
+                    Path::new(path),
+                    cache,
+                )?))),
+                Err(input) => Ok(Source::Stream(input)),
+            },
+            _ => Ok(Source::Stream(input)),
+        }
+    }
+}
@@ -0,0 +1,43 @@
+use super::render::FrameSender;
+use ilda::animation::{AnimationStreamWriter, Frame};
+use ilda::IldaError;
+use std::io::{Error as IoError, Write};
+
+// Where a producer sends its frames to, as given on its command line.
+pub enum Output {
+    // an ILDA stream
+    Ilda(Box<dyn Write>),
+    // ilda2wav arguments of a renderer in the same process
+    Render(String),
+}
+
+// Takes the frames of a producer. They are either encoded as an ILDA stream or handed to a renderer in the
+// same process, which skips encoding and decoding them.
+pub enum FrameSink<W: Write> {
+    Ilda(AnimationStreamWriter<W>),
+    Render(FrameSender),
+}
+
+impl<W: Write> FrameSink<W> {
+    pub fn write_frame<E>(&mut self, frame: Frame) -> Result<(), E>
+    where
+        E: From<IldaError> + From<IoError>,
+    {
+        match self {
+            FrameSink::Ilda(writer) => Ok(writer.write_frame(&frame)?),
+            FrameSink::Render(sender) => Ok(sender.send(frame)?),
+        }
+    }
+
+    // Ends the ILDA stream, or waits until the renderer is done.
+    pub fn finish<E>(self) -> Result<(), E>
+    where
+        E: From<IldaError> + From<IoError>,
+    {
+        match self {
+            FrameSink::Ilda(writer) => writer.finalize()?,
+            FrameSink::Render(sender) => sender.finish(),
+        }
+        Ok(())
+    }
+}
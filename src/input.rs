@@ -0,0 +1,107 @@
+use memmap::Mmap;
+use std::borrow::Cow;
+use std::fs::File;
+use std::io::{self, BufRead, BufReader, Read};
+use std::mem;
+use std::path::Path;
+
+// Pipes are read in blocks of this size.
+const BLOCK_SIZE: usize = 1024 * 1024;
+
+// Input of a tool. Regular files are memory-mapped, so decoders read them straight from the page cache.
+// Pipes and devices are read through a large buffer.
+pub enum Input {
+    Mapped { map: Mmap, pos: usize },
+    Buffered(BufReader<Box<dyn Read + Send>>),
+}
+
+impl Input {
+    pub fn open<P: AsRef<Path>>(path: P) -> io::Result<Input> {
+        let file = File::open(path)?;
+        let metadata = file.metadata()?;
+
+        // empty files can not be mapped, pipes and devices have no fixed length
+        if !metadata.is_file() || metadata.len() == 0 {
+            return Ok(Input::buffered(Box::new(file)));
+        }
+
+        // reading fails hard if another process truncates the file while it is mapped
+        match unsafe { Mmap::map(&file) } {
+            Ok(map) => Ok(Input::Mapped { map, pos: 0 }),
+            Err(_) => Ok(Input::buffered(Box::new(file))),
+        }
+    }
+
+    pub fn stdin() -> Input {
+        Input::buffered(Box::new(io::stdin()))
+    }
+
+    // Opens the given file or STDIN if no file is given.
+    pub fn open_or_stdin<P: AsRef<Path>>(path: Option<P>) -> io::Result<Input> {
+        match path {
+            Some(path) => Input::open(path),
+            None => Ok(Input::stdin()),
+        }
+    }
+
+    fn buffered(input: Box<dyn Read + Send>) -> Input {
+        Input::Buffered(BufReader::with_capacity(BLOCK_SIZE, input))
+    }
+
+    // The mapping of the whole file, gives the input back if it is not mapped.
+    pub fn into_map(self) -> Result<Mmap, Input> {
+        match self {
+            Input::Mapped { map, .. } => Ok(map),
+            input => Err(input),
+        }
+    }
+
+    // The rest of the input as one slice. Mapped files are borrowed, everything else is read into memory.
+    pub fn contents(&mut self) -> io::Result<Cow<[u8]>> {
+        match self {
+            Input::Mapped { map, pos } => {
+                let start = mem::replace(pos, map.len());
+                Ok(Cow::Borrowed(&map[start..]))
+            }
+            Input::Buffered(reader) => {
+                let mut data = vec![];
+                reader.read_to_end(&mut data)?;
+                Ok(Cow::Owned(data))
+            }
+        }
+    }
+}
+
+impl Read for Input {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        match self {
+            Input::Mapped { .. } => {
+                let n = {
+                    let data = self.fill_buf()?;
+                    let n = data.len().min(buf.len());
+                    buf[..n].copy_from_slice(&data[..n]);
+                    n
+                };
+                self.consume(n);
+                Ok(n)
+            }
+            Input::Buffered(reader) => reader.read(buf),
+        }
+    }
+}
+
+impl BufRead for Input {
+    fn fill_buf(&mut self) -> io::Result<&[u8]> {
+        match self {
+            Input::Mapped { map, pos } => Ok(&map[*pos..]),
+            Input::Buffered(reader) => reader.fill_buf(),
+        }
+    }
+
+    fn consume(&mut self, amt: usize) {
+        match self {
+            Input::Mapped { map, pos } => *pos = (*pos + amt).min(map.len()),
+            Input::Buffered(reader) => reader.consume(amt),
+        }
+    }
+}
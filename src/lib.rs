@@ -0,0 +1,14 @@
+// Code shared by the binaries and the benches
+
+pub mod flatten;
+pub mod frame_index;
+pub mod frame_sink;
+pub mod input;
+pub mod timed_iterator;
+pub mod memory_cycle;
+pub mod pcm;
+pub mod point_reader;
+pub mod render;
+pub mod ring_buffer;
+pub mod spectrum;
+pub mod stats;
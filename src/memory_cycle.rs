@@ -0,0 +1,57 @@
+use std::sync::Arc;
+
+// Yields the items of the underlying iterator and then repeats them forever.
+// Every item is stored once, repeating hands out shared references instead of copies.
+pub struct MemoryCycleIterator<I>
+where
+    I: Iterator,
+{
+    // dropped once it is exhausted, it is never polled again after that
+    iterator: Option<I>,
+    cycling: usize,
+    items: Vec<Arc<I::Item>>,
+}
+
+impl<I> Iterator for MemoryCycleIterator<I>
+where
+    I: Iterator,
+{
+    type Item = Arc<I::Item>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if let Some(iterator) = self.iterator.as_mut() {
+            match iterator.next() {
+                Some(item) => {
+                    let item = Arc::new(item);
+                    self.items.push(item.clone());
+                    return Some(item);
+                }
+                None => self.iterator = None,
+            }
+        }
+
+        // an empty input has nothing to repeat
+        if self.items.is_empty() {
+            return None;
+        }
+
+        let item = self.items[self.cycling].clone();
+        self.cycling = (self.cycling + 1) % self.items.len();
+        Some(item)
+    }
+}
+
+pub trait MemoryCycleIteratorExt: Iterator {
+    fn memory_cycle(self) -> MemoryCycleIterator<Self>
+    where
+        Self: Sized,
+    {
+        MemoryCycleIterator {
+            iterator: Some(self),
+            cycling: 0,
+            items: Vec::new(),
+        }
+    }
+}
+
+impl<I: Iterator> MemoryCycleIteratorExt for I {}
@@ -0,0 +1,180 @@
+use byteorder::{ByteOrder, LittleEndian};
+
+// Bulk conversion of normalized samples (-1.0 ~ 1.0) to signed integer PCM.
+// The sample format is a type parameter, so the per-format branch happens once per writer instead of
+// once per sample.
+
+// consts for mapping -1.0 ~ 1.0 to min/max values of i8,i16,i32: y = ax + b
+const I8A: f64 = (i8::max_value() as f64 - i8::min_value() as f64) / 2.0;
+const I8B: f64 = (i8::max_value() as f64 + i8::min_value() as f64) / 2.0;
+const I16A: f64 = (i16::max_value() as f64 - i16::min_value() as f64) / 2.0;
+const I16B: f64 = (i16::max_value() as f64 + i16::min_value() as f64) / 2.0;
+const I32A: f64 = (i32::max_value() as f64 - i32::min_value() as f64) / 2.0;
+const I32B: f64 = (i32::max_value() as f64 + i32::min_value() as f64) / 2.0;
+
+pub trait PcmFormat {
+    type Sample: Copy + Default + hound::Sample;
+
+    // Appends the quantized samples to out.
+    fn quantize(samples: &[f64], out: &mut Vec<Self::Sample>);
+
+    // Appends the little endian representation of samples to out.
+    fn to_le_bytes(samples: &[Self::Sample], out: &mut Vec<u8>);
+}
+
+pub struct Pcm8;
+// same as Pcm8, but the bytes are unsigned (offset by 128) as required by wav files
+pub struct Pcm8Wav;
+pub struct Pcm16;
+pub struct Pcm32;
+
+// Grows out by len default values and returns the new part.
+fn extend<T: Copy + Default>(out: &mut Vec<T>, len: usize) -> &mut [T] {
+    let start = out.len();
+    out.resize(start + len, T::default());
+    &mut out[start..]
+}
+
+// Out of range values are clamped, so the SIMD kernels and the scalar fallback never disagree.
+#[inline]
+fn clamp(sample: f64) -> f64 {
+    sample.max(-1.0).min(1.0)
+}
+
+impl PcmFormat for Pcm8 {
+    type Sample = i8;
+
+    fn quantize(samples: &[f64], out: &mut Vec<i8>) {
+        let out = extend(out, samples.len());
+        let done = simd::quantize_i8(samples, out, I8A, I8B);
+        for (o, s) in out[done..].iter_mut().zip(&samples[done..]) {
+            *o = (I8A * clamp(*s) + I8B) as i8;
+        }
+    }
+
+    fn to_le_bytes(samples: &[i8], out: &mut Vec<u8>) {
+        out.extend(samples.iter().map(|s| *s as u8));
+    }
+}
+
+impl PcmFormat for Pcm8Wav {
+    type Sample = i8;
+
+    fn quantize(samples: &[f64], out: &mut Vec<i8>) {
+        Pcm8::quantize(samples, out)
+    }
+
+    fn to_le_bytes(samples: &[i8], out: &mut Vec<u8>) {
+        out.extend(samples.iter().map(|s| *s as u8 ^ 0x80));
+    }
+}
+
+impl PcmFormat for Pcm16 {
+    type Sample = i16;
+
+    fn quantize(samples: &[f64], out: &mut Vec<i16>) {
+        let out = extend(out, samples.len());
+        let done = simd::quantize_i16(samples, out, I16A, I16B);
+        for (o, s) in out[done..].iter_mut().zip(&samples[done..]) {
+            *o = (I16A * clamp(*s) + I16B) as i16;
+        }
+    }
+
+    fn to_le_bytes(samples: &[i16], out: &mut Vec<u8>) {
+        LittleEndian::write_i16_into(samples, extend(out, samples.len() * 2));
+    }
+}
+
+impl PcmFormat for Pcm32 {
+    type Sample = i32;
+
+    fn quantize(samples: &[f64], out: &mut Vec<i32>) {
+        let out = extend(out, samples.len());
+        let done = simd::quantize_i32(samples, out, I32A, I32B);
+        for (o, s) in out[done..].iter_mut().zip(&samples[done..]) {
+            *o = (I32A * clamp(*s) + I32B) as i32;
+        }
+    }
+
+    fn to_le_bytes(samples: &[i32], out: &mut Vec<u8>) {
+        LittleEndian::write_i32_into(samples, extend(out, samples.len() * 4));
+    }
+}
+
+// SSE2 kernels. SSE2 is part of the x86_64 baseline, so no runtime feature detection is needed.
+// Each kernel converts as many samples as fit into whole vectors and returns that count, the remainder
+// is left to the scalar loop of the caller.
+#[cfg(target_arch = "x86_64")]
+mod simd {
+    use std::arch::x86_64::*;
+
+    // a * clamp(x) + b for 4 samples, truncated to 4 i32 lanes (same rounding as `as`)
+    #[inline(always)]
+    unsafe fn lanes(samples: *const f64, a: __m128d, b: __m128d) -> __m128i {
+        let min = _mm_set1_pd(-1.0);
+        let max = _mm_set1_pd(1.0);
+        let lo = _mm_min_pd(_mm_max_pd(_mm_loadu_pd(samples), min), max);
+        let hi = _mm_min_pd(_mm_max_pd(_mm_loadu_pd(samples.add(2)), min), max);
+        let lo = _mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(lo, a), b));
+        let hi = _mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(hi, a), b));
+        _mm_unpacklo_epi64(lo, hi)
+    }
+
+    pub fn quantize_i8(samples: &[f64], out: &mut [i8], a: f64, b: f64) -> usize {
+        let n = samples.len().min(out.len()) / 16 * 16;
+        unsafe {
+            let (a, b) = (_mm_set1_pd(a), _mm_set1_pd(b));
+            for i in (0..n).step_by(16) {
+                let s = samples.as_ptr().add(i);
+                let lo = _mm_packs_epi32(lanes(s, a, b), lanes(s.add(4), a, b));
+                let hi = _mm_packs_epi32(lanes(s.add(8), a, b), lanes(s.add(12), a, b));
+                _mm_storeu_si128(
+                    out.as_mut_ptr().add(i) as *mut __m128i,
+                    _mm_packs_epi16(lo, hi),
+                );
+            }
+        }
+        n
+    }
+
+    pub fn quantize_i16(samples: &[f64], out: &mut [i16], a: f64, b: f64) -> usize {
+        let n = samples.len().min(out.len()) / 8 * 8;
+        unsafe {
+            let (a, b) = (_mm_set1_pd(a), _mm_set1_pd(b));
+            for i in (0..n).step_by(8) {
+                let s = samples.as_ptr().add(i);
+                let v = _mm_packs_epi32(lanes(s, a, b), lanes(s.add(4), a, b));
+                _mm_storeu_si128(out.as_mut_ptr().add(i) as *mut __m128i, v);
+            }
+        }
+        n
+    }
+
+    pub fn quantize_i32(samples: &[f64], out: &mut [i32], a: f64, b: f64) -> usize {
+        let n = samples.len().min(out.len()) / 4 * 4;
+        unsafe {
+            let (a, b) = (_mm_set1_pd(a), _mm_set1_pd(b));
+            for i in (0..n).step_by(4) {
+                let v = lanes(samples.as_ptr().add(i), a, b);
+                _mm_storeu_si128(out.as_mut_ptr().add(i) as *mut __m128i, v);
+            }
+        }
+        n
+    }
+}
+
+// scalar fallback for other architectures
+#[cfg(not(target_arch = "x86_64"))]
+mod simd {
+    pub fn quantize_i8(_samples: &[f64], _out: &mut [i8], _a: f64, _b: f64) -> usize {
+        0
+    }
+
+    pub fn quantize_i16(_samples: &[f64], _out: &mut [i16], _a: f64, _b: f64) -> usize {
+        0
+    }
+
+    pub fn quantize_i32(_samples: &[f64], _out: &mut [i32], _a: f64, _b: f64) -> usize {
+        0
+    }
+}
@@ -0,0 +1,311 @@
+use byteorder::{ByteOrder, LittleEndian};
+use ilda::SimplePoint;
+use std::io::{BufRead, Error as IoError, ErrorKind};
+
+// Most bytes decoded at once
+pub const CHUNK_SIZE: usize = 64 * 1024;
+
+#[derive(Clone, Copy)]
+pub enum Encoding {
+    Signed8,
+    // 8 bit wav samples are unsigned
+    Unsigned8,
+    Signed16,
+    Signed32,
+}
+
+impl Encoding {
+    pub fn bytes(self) -> usize {
+        match self {
+            Encoding::Signed8 | Encoding::Unsigned8 => 1,
+            Encoding::Signed16 => 2,
+            Encoding::Signed32 => 4,
+        }
+    }
+
+    // Decodes little endian samples to -1.0~1.0
+    pub fn decode(self, input: &[u8], output: &mut [f64]) {
+        match self {
+            Encoding::Signed8 => {
+                for (o, i) in output.iter_mut().zip(input) {
+                    *o = *i as i8 as f64 / i8::max_value() as f64;
+                }
+            }
+            Encoding::Unsigned8 => {
+                for (o, i) in output.iter_mut().zip(input) {
+                    *o = (*i as i32 - 128) as f64 / i8::max_value() as f64;
+                }
+            }
+            Encoding::Signed16 => {
+                for (o, i) in output.iter_mut().zip(input.chunks_exact(2)) {
+                    *o = LittleEndian::read_i16(i) as f64 / i16::max_value() as f64;
+                }
+            }
+            Encoding::Signed32 => {
+                for (o, i) in output.iter_mut().zip(input.chunks_exact(4)) {
+                    *o = LittleEndian::read_i32(i) as f64 / i32::max_value() as f64;
+                }
+            }
+        }
+    }
+}
+
+#[derive(Clone, Copy)]
+pub enum Channel {
+    X,
+    XMirrored,
+    Y,
+    YMirrored,
+    Red,
+    Green,
+    Blue,
+    Blanking,
+    Ignore,
+}
+
+// The channel configuration, parsed once.
+pub struct Mapping {
+    channels: Vec<Channel>,
+    has_color: bool,
+}
+
+impl Mapping {
+    // fails with the first character that is not a channel
+    pub fn new(mapping_conf: &str) -> Result<Mapping, char> {
+        let channels = mapping_conf
+            .chars()
+            .map(|c| match c {
+                'x' => Ok(Channel::X),
+                'X' => Ok(Channel::XMirrored),
+                'y' => Ok(Channel::Y),
+                'Y' => Ok(Channel::YMirrored),
+                'r' => Ok(Channel::Red),
+                'g' => Ok(Channel::Green),
+                'b' => Ok(Channel::Blue),
+                'l' => Ok(Channel::Blanking),
+                '_' => Ok(Channel::Ignore),
+                _ => Err(c),
+            })
+            .collect::<Result<Vec<_>, _>>()?;
+
+        let has_color =
+            mapping_conf.contains('r') || mapping_conf.contains('g') || mapping_conf.contains('b');
+
+        Ok(Mapping {
+            channels,
+            has_color,
+        })
+    }
+
+    pub fn to_point(&self, normalized_input: &[f64]) -> SimplePoint {
+        let mut result = SimplePoint {
+            x: 0,
+            y: 0,
+            r: if self.has_color { 0 } else { 255 },
+            g: if self.has_color { 0 } else { 255 },
+            b: if self.has_color { 0 } else { 255 },
+            is_blank: false,
+        };
+
+        for (channel, value) in self.channels.iter().zip(normalized_input) {
+            match channel {
+                Channel::X => result.x = (value * i16::max_value() as f64) as i16,
+                Channel::XMirrored => result.x = (-value * i16::max_value() as f64) as i16,
+                Channel::Y => result.y = (value * i16::max_value() as f64) as i16,
+                Channel::YMirrored => result.y = (-value * i16::max_value() as f64) as i16,
+                Channel::Red => result.r = ((value + 1.0) / 2.0 * u8::max_value() as f64) as u8,
+                Channel::Green => result.g = ((value + 1.0) / 2.0 * u8::max_value() as f64) as u8,
+                Channel::Blue => result.b = ((value + 1.0) / 2.0 * u8::max_value() as f64) as u8,
+                Channel::Blanking => result.is_blank = *value < 0.0,
+                Channel::Ignore => {}
+            }
+        }
+
+        result
+    }
+}
+
+// Decodes all complete sample frames of a block straight from the buffer of the input.
+pub struct SimplePointReader {
+    input: Box<dyn BufRead>,
+    encoding: Encoding,
+    mapping: Mapping,
+    // a sample frame that is split between two blocks of the input
+    carry: Vec<u8>,
+    samples: Vec<f64>,
+    points: Vec<SimplePoint>,
+    next: usize,
+}
+
+impl SimplePointReader {
+    pub fn new(input: Box<dyn BufRead>, encoding: Encoding, mapping: Mapping) -> SimplePointReader {
+        SimplePointReader {
+            input,
+            encoding,
+            mapping,
+            carry: vec![],
+            samples: vec![],
+            points: vec![],
+            next: 0,
+        }
+    }
+
+    // Decodes the next chunk, returns false at the end of the input.
+    fn read_chunk(&mut self) -> Result<bool, IoError> {
+        let channels = self.mapping.channels.len();
+        if channels == 0 {
+            return Ok(false);
+        }
+        let frame_size = self.encoding.bytes() * channels;
+        let max_frames = (CHUNK_SIZE / frame_size).max(1);
+
+        loop {
+            let block = match self.input.fill_buf() {
+                Ok(block) => block,
+                Err(e) if e.kind() == ErrorKind::Interrupted => continue,
+                Err(e) => return Err(e),
+            };
+
+            // an incomplete sample frame at the end of the input is dropped
+            if block.is_empty() {
+                return Ok(false);
+            }
+
+            let (data, used) = if !self.carry.is_empty() || block.len() < frame_size {
+                let used = (frame_size - self.carry.len()).min(block.len());
+                self.carry.extend_from_slice(&block[..used]);
+                if self.carry.len() < frame_size {
+                    self.input.consume(used);
+                    continue;
+                }
+                (&self.carry[..], used)
+            } else {
+                let used = (block.len() / frame_size).min(max_frames) * frame_size;
+                (&block[..used], used)
+            };
+
+            self.samples.resize(data.len() / self.encoding.bytes(), 0.0);
+            self.encoding.decode(data, &mut self.samples);
+            self.carry.clear();
+            self.input.consume(used);
+
+            self.points.clear();
+            for frame in self.samples.chunks_exact(channels) {
+                self.points.push(self.mapping.to_point(frame));
+            }
+            self.next = 0;
+
+            return Ok(true);
+        }
+    }
+}
+
+impl Iterator for SimplePointReader {
+    type Item = Result<SimplePoint, IoError>;
+
+    fn next(&mut self) -> Option<Result<SimplePoint, IoError>> {
+        if self.next == self.points.len() {
+            match self.read_chunk() {
+                Ok(true) => {}
+                Ok(false) => return None,
+                Err(e) => return Some(Err(e)),
+            }
+        }
+
+        self.next += 1;
+        Some(Ok(self.points[self.next - 1].clone()))
+    }
+}
+
+// A frame rate as an exact fraction num / den
+#[derive(Clone, Copy, Debug)]
+pub struct Fps {
+    num: u64,
+    den: u64,
+}
+
+impl Fps {
+    // Parses a positive decimal number like 20 or 29.97, so that frame boundaries can be computed without
+    // rounding errors.
+    pub fn parse(fps: &str) -> Option<Fps> {
+        let (whole, fraction) = match fps.find('.') {
+            Some(dot) => (&fps[..dot], &fps[dot + 1..]),
+            None => (fps, ""),
+        };
+
+        // more digits do not fit into the integer math of the frame boundaries
+        let digits = whole.to_owned() + fraction;
+        if digits.is_empty() || digits.len() > 12 || !digits.bytes().all(|b| b.is_ascii_digit()) {
+            return None;
+        }
+
+        let num: u64 = digits.parse().ok()?;
+        let den = 10u64.pow(fraction.len() as u32);
+
+        if num == 0 {
+            None
+        } else {
+            Some(Fps { num, den })
+        }
+    }
+
+    // The sample at which a frame ends, rounded to the nearest sample: (frame + 1) * sample_rate / fps
+    pub fn frame_end(self, frame: u64, sample_rate: u32) -> u64 {
+        let exact = (frame as u128 + 1) * sample_rate as u128 * self.den as u128;
+        let num = self.num as u128;
+        ((exact * 2 + num) / (num * 2)) as u64
+    }
+}
+
+// Cuts the points of a sample stream into frames, a frame takes the points of sample_rate / fps samples.
+// Boundaries come from the frame number in integer math, so they do not drift over long inputs. The points
+// are moved into the frames, every frame starts with a fresh buffer.
+pub struct FrameCutter<I> {
+    points: I,
+    fps: Fps,
+    sample_rate: u32,
+    frame: u64,
+    samples: u64,
+    next_frame: u64,
+    capacity: usize,
+}
+
+impl<I> FrameCutter<I> {
+    pub fn new(points: I, fps: Fps, sample_rate: u32) -> FrameCutter<I> {
+        FrameCutter {
+            points,
+            fps,
+            sample_rate,
+            frame: 0,
+            samples: 0,
+            next_frame: fps.frame_end(0, sample_rate),
+            capacity: fps.frame_end(0, sample_rate) as usize + 1,
+        }
+    }
+}
+
+impl<I, E> Iterator for FrameCutter<I>
+where
+    I: Iterator<Item = Result<SimplePoint, E>>,
+{
+    type Item = Result<Vec<SimplePoint>, E>;
+
+    // The last frame holds the points that are left at the end of the input, if any.
+    fn next(&mut self) -> Option<Result<Vec<SimplePoint>, E>> {
+        let mut points = Vec::with_capacity(self.capacity);
+
+        while self.samples < self.next_frame {
+            match self.points.next() {
+                Some(Ok(point)) => points.push(point),
+                Some(Err(e)) => return Some(Err(e)),
+                None if points.is_empty() => return None,
+                None => return Some(Ok(points)),
+            }
+            self.samples += 1;
+        }
+
+        self.frame += 1;
+        self.next_frame = self.fps.frame_end(self.frame, self.sample_rate);
+        Some(Ok(points))
+    }
+}
@@ -0,0 +1,2373 @@
+use super::frame_index::{IndexedAnimation, Source};
+use super::input::Input;
+use super::memory_cycle::MemoryCycleIteratorExt;
+use super::pcm::{Pcm16, Pcm32, Pcm8, Pcm8Wav, PcmFormat};
+use super::ring_buffer::{ring_buffer, Consumer, Producer};
+use super::stats::{self, Format as StatsFormat, Stage, StageTimer, Stats};
+use byteorder::{LittleEndian, WriteBytesExt};
+use clap::{App, Arg};
+use cpal::traits::{DeviceTrait, HostTrait, StreamTrait};
+use cpal::{BufferSize, SampleFormat, SampleRate, StreamConfig};
+use hound::{Error as HoundError, WavSpec, WavWriter};
+use ilda::animation::{Animation, Frame};
+use ilda::SimplePoint;
+use std::collections::BTreeMap;
+use std::f64::consts::PI;
+use std::ffi::OsString;
+use std::fmt::Display;
+use std::fs::File;
+use std::io::{self, BufWriter, Error as IoError, ErrorKind, Seek, Write};
+use std::iter;
+use std::mem;
+use std::ops::Range;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc::{Receiver, SyncSender};
+use std::sync::{mpsc, Arc, Mutex};
+use std::thread;
+use std::time::Duration;
+
+// Consumes blocks of interleaved samples (one value per channel and sample, channel by channel).
+// A block usually holds all samples of a single frame.
+pub trait SampleWrite {
+    fn write(&mut self, samples: &[f64]) -> Result<(), IoError>;
+    fn finish(self: Box<Self>) -> Result<(), IoError>;
+}
+
+pub enum BytesPerSample {
+    OneByte,
+    TwoBytes,
+    FourBytes,
+}
+
+struct PcmWriter<T: Write, F: PcmFormat> {
+    writer: T,
+    quantized: Vec<F::Sample>,
+    bytes: Vec<u8>,
+}
+
+impl<T: Write, F: PcmFormat> PcmWriter<T, F> {
+    fn new(writer: T) -> PcmWriter<T, F> {
+        PcmWriter {
+            writer,
+            quantized: vec![],
+            bytes: vec![],
+        }
+    }
+}
+
+impl<T: Write, F: PcmFormat> SampleWrite for PcmWriter<T, F> {
+    fn write(&mut self, samples: &[f64]) -> Result<(), IoError> {
+        self.quantized.clear();
+        self.bytes.clear();
+        F::quantize(samples, &mut self.quantized);
+        F::to_le_bytes(&self.quantized, &mut self.bytes);
+
+        self.writer.write_all(&self.bytes)?;
+
+        // flush once per block instead of once per sample
+        self.writer.flush()
+    }
+
+    fn finish(self: Box<Self>) -> Result<(), IoError> {
+        Ok(())
+    }
+}
+
+pub fn pcm_writer<T: Write + 'static>(writer: T, bps: BytesPerSample) -> Box<dyn SampleWrite> {
+    match bps {
+        BytesPerSample::OneByte => Box::new(PcmWriter::<T, Pcm8>::new(writer)),
+        BytesPerSample::TwoBytes => Box::new(PcmWriter::<T, Pcm16>::new(writer)),
+        BytesPerSample::FourBytes => Box::new(PcmWriter::<T, Pcm32>::new(writer)),
+    }
+}
+
+// raw PCM after a header written by write_wav_header, 8 bit samples are unsigned in wav files
+fn wav_stream_writer<T: Write + 'static>(writer: T, bps: BytesPerSample) -> Box<dyn SampleWrite> {
+    match bps {
+        BytesPerSample::OneByte => Box::new(PcmWriter::<T, Pcm8Wav>::new(writer)),
+        _ => pcm_writer(writer, bps),
+    }
+}
+
+// Writes a PCM wav header for the given amount of samples per channel.
+// If that amount is not known (or too large for a wav file), all sizes are set to the maximum value,
+// which is the usual convention for wav streams of unknown length.
+fn write_wav_header<W: Write>(
+    writer: &mut W,
+    spec: &WavSpec,
+    samples: Option<u64>,
+) -> Result<(), IoError> {
+    let bytes_per_sample = spec.bits_per_sample as u32 / 8;
+    let block_align = spec.channels as u32 * bytes_per_sample;
+
+    let data_len = samples
+        .map(|samples| samples * block_align as u64)
+        .filter(|len| *len <= (u32::max_value() - 36) as u64)
+        .map(|len| len as u32);
+
+    writer.write_all(b"RIFF")?;
+    writer.write_u32::<LittleEndian>(data_len.map_or(u32::max_value(), |len| len + 36))?;
+    writer.write_all(b"WAVE")?;
+    writer.write_all(b"fmt ")?;
+    writer.write_u32::<LittleEndian>(16)?;
+    writer.write_u16::<LittleEndian>(1)?; // PCM
+    writer.write_u16::<LittleEndian>(spec.channels)?;
+    writer.write_u32::<LittleEndian>(spec.sample_rate)?;
+    writer.write_u32::<LittleEndian>(spec.sample_rate * block_align)?;
+    writer.write_u16::<LittleEndian>(block_align as u16)?;
+    writer.write_u16::<LittleEndian>(spec.bits_per_sample)?;
+    writer.write_all(b"data")?;
+    writer.write_u32::<LittleEndian>(data_len.unwrap_or(u32::max_value()))
+}
+
+struct HoundWriter<W: Write + Seek, F: PcmFormat> {
+    hound: WavWriter<W>,
+    quantized: Vec<F::Sample>,
+}
+
+fn map_hound_error(e: HoundError) -> IoError {
+    match e {
+        HoundError::IoError(e) => e,
+        _ => panic!("Unexpected hound error."),
+    }
+}
+
+impl<W: Write + Seek, F: PcmFormat> SampleWrite for HoundWriter<W, F> {
+    fn write(&mut self, samples: &[f64]) -> Result<(), IoError> {
+        self.quantized.clear();
+        F::quantize(samples, &mut self.quantized);
+
+        for sample in &self.quantized {
+            self.hound.write_sample(*sample).map_err(map_hound_error)?
+        }
+
+        Ok(())
+    }
+
+    fn finish(self: Box<Self>) -> Result<(), IoError> {
+        self.hound.finalize().map_err(map_hound_error)
+    }
+}
+
+pub fn hound_writer<W: Write + Seek + 'static>(
+    hound: WavWriter<W>,
+    bps: BytesPerSample,
+) -> Box<dyn SampleWrite> {
+    match bps {
+        BytesPerSample::OneByte => Box::new(HoundWriter::<W, Pcm8> {
+            hound,
+            quantized: vec![],
+        }),
+        BytesPerSample::TwoBytes => Box::new(HoundWriter::<W, Pcm16> {
+            hound,
+            quantized: vec![],
+        }),
+        BytesPerSample::FourBytes => Box::new(HoundWriter::<W, Pcm32> {
+            hound,
+            quantized: vec![],
+        }),
+    }
+}
+
+// Plays samples on an audio device.
+// The device callback pulls whole sample frames from a ring buffer of two periods and plays silence on
+// underruns, write() blocks while the ring buffer is full.
+struct DeviceWriter {
+    producer: Producer<f32>,
+    converted: Vec<f32>,
+    underruns: Arc<AtomicUsize>,
+    period: Duration,
+    stream: cpal::Stream,
+    started: bool,
+}
+
+fn to_io_error<E: Display>(e: E) -> IoError {
+    IoError::new(ErrorKind::Other, e.to_string())
+}
+
+impl DeviceWriter {
+    fn new(
+        name: Option<&str>,
+        channels: u16,
+        sample_rate: u32,
+        period: u32,
+    ) -> Result<DeviceWriter, IoError> {
+        let host = cpal::default_host();
+
+        let device = match name {
+            Some(name) => host
+                .output_devices()
+                .map_err(to_io_error)?
+                .find(|device| device.name().map(|n| n == name).unwrap_or(false)),
+            None => host.default_output_device(),
+        }
+        .ok_or_else(|| IoError::new(ErrorKind::NotFound, "Audio device not found."))?;
+
+        let config = StreamConfig {
+            channels,
+            sample_rate: SampleRate(sample_rate),
+            buffer_size: BufferSize::Fixed(period),
+        };
+
+        let (producer, consumer) = ring_buffer(period as usize * channels as usize * 2);
+        let underruns = Arc::new(AtomicUsize::new(0));
+
+        let sample_format = device
+            .default_output_config()
+            .map_err(to_io_error)?
+            .sample_format();
+
+        let stream = match sample_format {
+            SampleFormat::F32 => {
+                output_stream::<f32>(&device, &config, consumer, underruns.clone())
+            }
+            SampleFormat::I16 => {
+                output_stream::<i16>(&device, &config, consumer, underruns.clone())
+            }
+            SampleFormat::U16 => {
+                output_stream::<u16>(&device, &config, consumer, underruns.clone())
+            }
+        }
+        .map_err(to_io_error)?;
+
+        Ok(DeviceWriter {
+            producer,
+            converted: vec![],
+            underruns,
+            period: Duration::from_secs_f64(period as f64 / sample_rate as f64),
+            stream,
+            started: false,
+        })
+    }
+
+    // the device is started once the ring buffer is full for the first time
+    fn start(&mut self) -> Result<(), IoError> {
+        if !self.started {
+            self.started = true;
+            self.stream.play().map_err(to_io_error)?;
+        }
+        Ok(())
+    }
+}
+
+fn output_stream<T: cpal::Sample>(
+    device: &cpal::Device,
+    config: &StreamConfig,
+    mut consumer: Consumer<f32>,
+    underruns: Arc<AtomicUsize>,
+) -> Result<cpal::Stream, cpal::BuildStreamError> {
+    let channels = config.channels as usize;
+    let mut buffer = vec![0.0; consumer.capacity()];
+
+    device.build_output_stream(
+        config,
+        move |data: &mut [T], _: &cpal::OutputCallbackInfo| {
+            if buffer.len() < data.len() {
+                buffer.resize(data.len(), 0.0);
+            }
+            let buffer = &mut buffer[..data.len()];
+
+            // only take whole sample frames, so that channels never get shifted
+            let available = consumer.len().min(data.len()) / channels * channels;
+            let n = consumer.pop_slice(&mut buffer[..available]);
+            if n < data.len() {
+                for sample in buffer[n..].iter_mut() {
+                    *sample = 0.0;
+                }
+                if !consumer.is_closed() {
+                    underruns.fetch_add(1, Ordering::Relaxed);
+                }
+            }
+
+            for (out, sample) in data.iter_mut().zip(buffer.iter()) {
+                *out = cpal::Sample::from(sample);
+            }
+        },
+        |e| eprintln!("Audio device error: {}", e),
+    )
+}
+
+impl SampleWrite for DeviceWriter {
+    fn write(&mut self, samples: &[f64]) -> Result<(), IoError> {
+        self.converted.clear();
+        self.converted.extend(samples.iter().map(|s| *s as f32));
+
+        let mut pushed = self.producer.push_slice(&self.converted);
+        while pushed < self.converted.len() {
+            self.start()?;
+            thread::sleep(self.period / 4);
+            pushed += self.producer.push_slice(&self.converted[pushed..]);
+        }
+
+        Ok(())
+    }
+
+    fn finish(mut self: Box<Self>) -> Result<(), IoError> {
+        self.start()?;
+
+        // let the device play what is left
+        while self.producer.len() > 0 {
+            thread::sleep(self.period / 4);
+        }
+        thread::sleep(self.period * 2);
+
+        eprintln!("Underruns: {}", self.underruns.load(Ordering::Relaxed));
+
+        Ok(())
+    }
+}
+
+// Where the frames to render come from.
+enum FrameInput {
+    Read(Source),
+    // frames handed over by a producer in the same process
+    Produced(Receiver<Frame>),
+}
+
+pub struct Options {
+    input: FrameInput,
+    range: Range<usize>,
+    output: Box<dyn SampleWrite>,
+    renderer: Renderer,
+    repeat: bool,
+    cache: usize,
+    latency: Option<f64>,
+    jobs: Option<usize>,
+    sample_rate: u32,
+    stats: Option<Arc<Stats>>,
+}
+
+impl Options {
+    // a renderer with the parsed settings, without any input or output
+    pub fn renderer(&self) -> Renderer {
+        self.renderer.clone()
+    }
+}
+
+// maps all points of a frame to the values of one channel
+type Mapper = fn(&[SimplePoint], &mut [f64]);
+
+#[derive(Clone)]
+struct MapConfiguration {
+    mapper: Mapper,
+    is_axis: bool,
+}
+
+// A single output channel. Implemented by zero sized types so that map_channel is compiled into a
+// separate kernel for every channel. The kernels are picked once from the channel string and then
+// called once per channel and frame, not per point. Used for layouts without a kernel of their own.
+trait Channel {
+    const IS_AXIS: bool;
+    fn map(point: &SimplePoint) -> f64;
+}
+
+macro_rules! channel {
+    ($name:ident, $map:ident, $is_axis:expr) => {
+        struct $name;
+
+        impl Channel for $name {
+            const IS_AXIS: bool = $is_axis;
+
+            #[inline(always)]
+            fn map(point: &SimplePoint) -> f64 {
+                $map(point)
+            }
+        }
+    };
+}
+
+channel!(AxisX, map_x, true);
+channel!(AxisXInv, map_x_inv, true);
+channel!(AxisY, map_y, true);
+channel!(AxisYInv, map_y_inv, true);
+channel!(Red, map_r, false);
+channel!(Green, map_g, false);
+channel!(Blue, map_b, false);
+channel!(Blanking, map_l, false);
+channel!(On, map_on, false);
+channel!(Off, map_off, false);
+channel!(Silence, map_none, false);
+
+fn map_channel<C: Channel>(points: &[SimplePoint], pos: &mut [f64]) {
+    for (pos, point) in pos.iter_mut().zip(points) {
+        *pos = C::map(point);
+    }
+}
+
+fn channel<C: Channel>() -> MapConfiguration {
+    MapConfiguration {
+        mapper: map_channel::<C>,
+        is_axis: C::IS_AXIS,
+    }
+}
+
+// maps all points of a frame and their distances starting at cur_pos (last argument)
+type LayoutMapper = fn(&mut FramePoints, &[SimplePoint], &[MapConfiguration], &[f64]);
+
+// A kernel for a whole channel layout. Every point is read once and all of its channels and the
+// distance to the previous point are computed in the same pass, with the channels inlined. The
+// channel configurations are not used, the layout is part of the kernel.
+macro_rules! layout {
+    ($name:ident, $($i:expr => $channel:ident),+) => {
+        fn $name(
+            frame: &mut FramePoints,
+            points: &[SimplePoint],
+            _channels: &[MapConfiguration],
+            cur_pos: &[f64],
+        ) {
+            let len = points.len();
+            frame.reset([$($i),+].len(), len);
+
+            let pos = &mut frame.pos;
+            let mut last = [$(cur_pos[$i]),+];
+            for (k, (point, dist)) in points.iter().zip(frame.dist.iter_mut()).enumerate() {
+                let mut squared = 0.0;
+                $(
+                    let value = $channel::map(point);
+                    pos[$i * len + k] = value;
+                    if $channel::IS_AXIS {
+                        let d = value - last[$i];
+                        squared += d * d;
+                        last[$i] = value;
+                    }
+                )+
+                *dist = squared.sqrt();
+            }
+        }
+    };
+}
+
+layout!(layout_xy, 0 => AxisX, 1 => AxisY);
+layout!(layout_xyl, 0 => AxisX, 1 => AxisY, 2 => Blanking);
+layout!(layout_xyrgb, 0 => AxisX, 1 => AxisY, 2 => Red, 3 => Green, 4 => Blue);
+layout!(layout_5_1, 0 => Silence, 1 => Silence, 2 => Blanking, 3 => Silence, 4 => AxisX, 5 => AxisY);
+
+// The kernel for the common layouts, other layouts are mapped channel by channel.
+fn layout_mapper(channels: &str) -> LayoutMapper {
+    match channels {
+        "xy" => layout_xy,
+        "xyl" => layout_xyl,
+        "xyrgb" => layout_xyrgb,
+        "__l_xy" => layout_5_1,
+        _ => FramePoints::map,
+    }
+}
+
+// Parses ilda2wav arguments, args starts with the program name.
+// If produced is given, the frames come from it instead of an input file.
+pub fn get_options<I, T>(args: I, produced: Option<Receiver<Frame>>) -> Options
+where
+    I: IntoIterator<Item = T>,
+    T: Into<OsString> + Clone,
+{
+    let matches = App::new("ilda2gui")
+        .version("0.1.0")
+        .author("Lukas <lukasjapan@gmail.com>")
+        .about("Generates a wav file for an ILDA projector hooked to a sound card.")
+        .arg(
+            Arg::with_name("PPS")
+                .short("p")
+                .long("pps")
+                .default_value("10000")
+                .help("Point per second of the projector. The maximum limit of points that is sent to the projector per second.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("CORRECTNESS")
+                .short("c")
+                .long("correctness")
+                .default_value("1.0")
+                .help(r#"Defines how much time should be used as a minimum per point.
+0~1: points may be dropped
+1: Guarantee at least pps points per second (default)
+1~: Use extra time per point
+
+A value above 1 may lower the pps of your device on frames with a lot of points.
+For example a value of 2 will allocate the double amount of time per point, effectively cutting pps in half.
+
+If a frame contains too many points for the projector to handle, a value below 1 allows points to be dropped from rendering.
+Points that are close to each other are more likely to be dropped.
+Any value above zero may slow down the animation."#)
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("FPS")
+                .short("f")
+                .long("fps")
+                .default_value("20.0")
+                .help("Try to draw this number of frames per second.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("SAMPLERATE")
+                .short("s")
+                .long("sample-rate")
+                .default_value("44100")
+                .help("Sample rate of the output wav.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("BPS")
+                .short("b")
+                .long("bps")
+                .default_value("16")
+                .help("Bits per sample of the output wav.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("REPEAT")
+                .short("r")
+                .long("repeat")
+                .help("Repeats the input animation forever. Can only be used if outputting raw PCM samples to STDOUT or to an audio device."),
+        )
+        .arg(
+            Arg::with_name("CACHE")
+                .long("cache")
+                .default_value("64")
+                .help("Memory budget in MiB for repeating the input. One loop of the animation is rendered into memory and played from there, if its frames and samples fit. Larger animations and endless inputs are rendered again on every loop. 0 disables the cache.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("DEVICE")
+                .short("d")
+                .long("device")
+                .help("Plays the samples directly on an audio device instead of writing them. Uses the default device if no name is given. The bits per sample setting is ignored.")
+                .takes_value(true)
+                .min_values(0),
+        )
+        .arg(
+            Arg::with_name("PERIOD")
+                .long("period")
+                .default_value("256")
+                .help("Period size of the audio device in samples per channel. Lower values reduce the latency but need a faster system.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("JOBS")
+                .short("j")
+                .long("jobs")
+                .help("Renders frames on this many worker threads. The output is identical to rendering on a single thread.")
+                .takes_value(true)
+                .conflicts_with("LATENCY"),
+        )
+        .arg(
+            Arg::with_name("LATENCY")
+                .short("l")
+                .long("latency")
+                .help(r#"Renders frames on a separate thread into a buffer that holds this many milliseconds of samples.
+The output is written from its own thread in periods of a quarter of the buffer.
+Buffer depth and underruns are reported on STDERR about once per second of output.
+If not given, frames are rendered and written on the same thread."#)
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("START")
+                .long("start")
+                .help("Number of the first frame to render, counted from 0. Indexed files jump right there, other inputs are decoded up to it.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("END")
+                .long("end")
+                .help("Number of the frame to stop before. If not given, the input is rendered to its end.")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("STATS")
+                .long("stats")
+                .help("Reports runtime statistics on STDERR about once per second: frames, points and samples per second, frames over budget, dropped points, the parallel render queue and the time of the decode, map, render and write stages (mean/p99/max). Give json to print every report as one JSON line.")
+                .takes_value(true)
+                .min_values(0),
+        )
+        .arg(
+            Arg::with_name("INDEX")
+                .long("index")
+                .help("Keeps the frame index of the input file in a sidecar file (FILE.idx) and reuses it while the file does not change. Input files are indexed if jobs, start or end is given.")
+        )
+        .arg(
+            Arg::with_name("RAW")
+                .short("a")
+                .long("raw")
+                .help("Output raw PCM data. (Do not write wav header)"),
+        )
+        .arg(
+            Arg::with_name("CHANNELS")
+                .help(r#"A string that defines the output channel configuration. Use one or more of the following characters:
+x: X-Axis
+X: X-Axis mirrored
+y: Y-Axis
+Y: Y-Axis mirrored
+r: Intensity of Red component
+g: Intensity of Green component
+b: Intensity of Blue component
+l: Blanking signal
+1: Always high
+0: Always low
+_: Silence
+
+Ex:
+A stereo file that controls the axis only: xy
+A 5.1 channel file that controls the axis with rear channels and includes the blanking signal: __l_xy
+"#)
+                .required(true)
+                .index(1),
+        )
+        .arg(
+            Arg::with_name("FILES")
+                .multiple(true)
+                .help(r#"Specify 0~2 filenames.
+0 filename: Read the input from STDIN and write the output to STDOUT
+1 filename with .ild extension: Read the input from the given file and write the output to STDOUT
+1 filename with .wav extension: Read the input from STDIN and write the output to the given file
+2 filenames: Read the input from the first file and write the output to the second file
+
+If writing a wav file to STDOUT, the input file is read twice to determine the length of the output.
+If the input comes from STDIN, the wav header declares an unknown length instead.
+                "#)
+                .max_values(2)
+                .index(2),
+        )
+        .arg(
+            Arg::with_name("MDPS")
+                .short("m")
+                .long("mdps")
+                .help(r#"Maximum speed of the galvos in sweeps per second. A sweep is a move from one edge of the projection to the other.
+Enables the motion planner: moves take at least the time the galvos need at this speed, the beam slows down before corners and waits at them, and close points are merged if a frame is too long.
+If not given, the time of a frame is only split by distance."#)
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("ACCELERATION")
+                .long("acceleration")
+                .help("Maximum acceleration of the galvos in sweeps per second squared. Only used together with mdps. If not given, the speed is only limited by mdps.")
+                .takes_value(true)
+                .requires("MDPS"),
+        )
+        .arg(
+            Arg::with_name("CORNER")
+                .long("corner")
+                .default_value("0")
+                .help("Milliseconds the beam waits at a turn back, smaller turns wait proportionally shorter. Only used together with mdps.")
+                .takes_value(true),
+        )
+        .get_matches_from(args);
+
+    let channels = {
+        let result: Result<Vec<_>, _> = matches
+            .value_of("CHANNELS")
+            .unwrap()
+            .chars()
+            .map(|v| match v {
+                'x' => Ok(channel::<AxisX>()),
+                'X' => Ok(channel::<AxisXInv>()),
+                'y' => Ok(channel::<AxisY>()),
+                'Y' => Ok(channel::<AxisYInv>()),
+                'r' => Ok(channel::<Red>()),
+                'g' => Ok(channel::<Green>()),
+                'b' => Ok(channel::<Blue>()),
+                'l' => Ok(channel::<Blanking>()),
+                '1' => Ok(channel::<On>()),
+                '0' => Ok(channel::<Off>()),
+                '_' => Ok(channel::<Silence>()),
+                _ => Err(()),
+            })
+            .collect();
+
+        result.expect("Invalid Channel.")
+    };
+
+    if channels.is_empty() {
+        panic!("No channels given.")
+    }
+
+    let files: Vec<&str> = match matches.values_of("FILES") {
+        Some(files) => files.collect(),
+        None => vec![],
+    };
+
+    let file_in = match files.len() {
+        0 => None,
+        1 => {
+            if files[0].to_lowercase().ends_with(".ild") {
+                Some(files[0])
+            } else {
+                None
+            }
+        }
+        2 => Some(files[0]),
+        _ => panic!("This should never happen."),
+    };
+    let file_out = match files.len() {
+        0 => None,
+        1 => {
+            if files[0].to_lowercase().ends_with(".wav") {
+                Some(files[0])
+            } else {
+                None
+            }
+        }
+        2 => Some(files[1]),
+        _ => panic!("This should never happen."),
+    };
+
+    if files.len() == 1 && file_in.is_none() && file_out.is_none() {
+        panic!("Failed to determine if given file is meant for input or output.")
+    }
+
+    let raw_pcm = matches.is_present("RAW");
+
+    let sample_rate: u32 = matches
+        .value_of("SAMPLERATE")
+        .unwrap()
+        .parse()
+        .expect("Invalid number.");
+
+    let bits_per_sample: u32 = matches
+        .value_of("BPS")
+        .unwrap()
+        .parse()
+        .expect("Invalid number.");
+
+    let bits_per_sample_enum = match bits_per_sample {
+        8 => BytesPerSample::OneByte,
+        16 => BytesPerSample::TwoBytes,
+        32 => BytesPerSample::FourBytes,
+        _ => panic!("Invalid sample rate."),
+    };
+
+    let bits_per_sample: u16 = matches
+        .value_of("BPS")
+        .unwrap()
+        .parse()
+        .expect("Invalid number.");
+
+    let motion = matches.value_of("MDPS").map(|mdps| {
+        let parse = |v: &str| v.parse::<f64>().expect("Invalid number.");
+        // a sweep crosses the axis range of -1 to 1
+        Motion {
+            max_speed: parse(mdps) * 2.0,
+            acceleration: matches
+                .value_of("ACCELERATION")
+                .map_or(std::f64::INFINITY, |v| parse(v) * 2.0),
+            corner_dwell: parse(matches.value_of("CORNER").unwrap()) / 1000.0,
+        }
+    });
+
+    let mut renderer = Renderer::new(
+        channels,
+        layout_mapper(matches.value_of("CHANNELS").unwrap()),
+        matches
+            .value_of("FPS")
+            .unwrap()
+            .parse()
+            .expect("Invalid number."),
+        matches
+            .value_of("PPS")
+            .unwrap()
+            .parse()
+            .expect("Invalid number."),
+        matches
+            .value_of("CORRECTNESS")
+            .unwrap()
+            .parse()
+            .expect("Invalid number."),
+        motion,
+        sample_rate,
+    );
+
+    let start = matches
+        .value_of("START")
+        .map_or(0, |v| v.parse::<usize>().expect("Invalid number."));
+    let end = matches.value_of("END").map_or(usize::max_value(), |v| {
+        v.parse::<usize>().expect("Invalid number.")
+    });
+
+    if end <= start {
+        panic!("The end frame must come after the start frame.")
+    }
+
+    let jobs = matches
+        .value_of("JOBS")
+        .map(|v| v.parse::<usize>().expect("Invalid number.").max(1));
+
+    let index = jobs.is_some()
+        || matches.is_present("START")
+        || matches.is_present("END")
+        || matches.is_present("INDEX");
+
+    let input = match produced {
+        Some(_) if file_in.is_some() => {
+            panic!("An input file can not be used together with a producer.")
+        }
+        Some(frames) => FrameInput::Produced(frames),
+        None => FrameInput::Read(
+            Source::open(file_in, index, matches.is_present("INDEX"))
+                .expect("Failed to open file."),
+        ),
+    };
+
+    let repeat = matches.is_present("REPEAT");
+
+    let stats = if matches.is_present("STATS") {
+        let format = StatsFormat::parse(matches.value_of("STATS")).expect("Invalid stats format.");
+        Some(Stats::start(format))
+    } else {
+        None
+    };
+    renderer.stats = stats.clone();
+
+    let device = matches.is_present("DEVICE");
+
+    if device && file_out.is_some() {
+        panic!("An output file can not be used together with an audio device.")
+    }
+
+    let output: Box<dyn SampleWrite> = if device {
+        let period = matches
+            .value_of("PERIOD")
+            .unwrap()
+            .parse()
+            .expect("Invalid number.");
+
+        Box::new(
+            DeviceWriter::new(
+                matches.value_of("DEVICE"),
+                renderer.channels.len() as u16,
+                sample_rate,
+                period,
+            )
+            .expect("Failed to open audio device."),
+        )
+    } else if raw_pcm {
+        match file_out {
+            Some(filename) => {
+                let writer = BufWriter::new(File::create(filename).expect("Failed to open file."));
+                pcm_writer(writer, bits_per_sample_enum)
+            }
+            None => pcm_writer(BufWriter::new(io::stdout()), bits_per_sample_enum),
+        }
+    } else {
+        let spec = WavSpec {
+            channels: renderer.channels.len() as u16,
+            sample_rate,
+            bits_per_sample,
+            sample_format: hound::SampleFormat::Int,
+        };
+
+        match file_out {
+            Some(filename) => {
+                let hound = WavWriter::create(filename, spec).expect("Failed to init wav.");
+                hound_writer(hound, bits_per_sample_enum)
+            }
+            None => {
+                // STDOUT can not seek back to patch the header, so the length has to be known up front
+                let samples =
+                    file_in.map(|filename| count_samples(&input, filename, start..end, &renderer));
+                let mut writer = BufWriter::new(io::stdout());
+                write_wav_header(&mut writer, &spec, samples).expect("Failed to init wav.");
+                wav_stream_writer(writer, bits_per_sample_enum)
+            }
+        }
+    };
+
+    let output: Box<dyn SampleWrite> = match &stats {
+        Some(stats) => Box::new(StatsWriter {
+            output,
+            stats: stats.clone(),
+            channels: renderer.channels.len(),
+        }),
+        None => output,
+    };
+
+    if repeat && !(device || file_out.is_none() && raw_pcm) {
+        panic!("Repeating input is only allowed when outputting raw PCM samples to STDOUT or to an audio device.")
+    }
+
+    let latency = matches
+        .value_of("LATENCY")
+        .map(|v| v.parse::<f64>().expect("Invalid number.") / 1000.0);
+
+    let cache = matches
+        .value_of("CACHE")
+        .unwrap()
+        .parse::<usize>()
+        .expect("Invalid number.")
+        * 1024
+        * 1024
+        / std::mem::size_of::<f64>();
+
+    Options {
+        input,
+        range: start..end,
+        output,
+        renderer,
+        repeat,
+        cache,
+        latency,
+        jobs,
+        sample_rate,
+        stats,
+    }
+}
+
+fn map_x(point: &SimplePoint) -> f64 {
+    point.x as f64 / std::i16::MAX as f64
+}
+fn map_y(point: &SimplePoint) -> f64 {
+    point.y as f64 / std::i16::MAX as f64
+}
+fn map_x_inv(point: &SimplePoint) -> f64 {
+    -(point.x as f64 / std::i16::MAX as f64)
+}
+fn map_y_inv(point: &SimplePoint) -> f64 {
+    -(point.y as f64 / std::i16::MAX as f64)
+}
+fn map_r(point: &SimplePoint) -> f64 {
+    point.r as f64 * 2.0 / std::u8::MAX as f64 - 1.0
+}
+fn map_g(point: &SimplePoint) -> f64 {
+    point.g as f64 * 2.0 / std::u8::MAX as f64 - 1.0
+}
+fn map_b(point: &SimplePoint) -> f64 {
+    point.b as f64 * 2.0 / std::u8::MAX as f64 - 1.0
+}
+fn map_l(point: &SimplePoint) -> f64 {
+    if point.is_blank {
+        -1.0
+    } else {
+        1.0
+    }
+}
+fn map_on(_point: &SimplePoint) -> f64 {
+    1.0
+}
+fn map_none(_point: &SimplePoint) -> f64 {
+    0.0
+}
+fn map_off(_point: &SimplePoint) -> f64 {
+    -1.0
+}
+
+// track progress
+#[derive(Clone)]
+struct WavProgress {
+    cur_time: f64,
+    cur_sample: u64,
+    time_per_sample: f64,
+}
+
+impl WavProgress {
+    fn advance(&mut self, dt: f64) -> u64 {
+        // this point can be drawn until this time
+        let next_time = self.cur_time + dt;
+        // current time in wav file (wav time advances in ticks of time_per_sample)
+        let cur_sample_time = self.cur_sample as f64 * self.time_per_sample;
+        // time range that is available to output samples for this point
+        let sample_range = (next_time - cur_sample_time).max(0.0);
+        // amount of samples that can be drawn for this point
+        let n = (sample_range / self.time_per_sample).ceil() as u64;
+        // advance
+        self.cur_time = next_time;
+        self.cur_sample = self.cur_sample + n;
+        //        eprintln!(
+        //            "next_time={}, cur_sample_time={}, sample_range={}, n={}, time_per_sample={}",
+        //            next_time, cur_sample_time, sample_range, n, self.time_per_sample
+        //        );
+        n
+    }
+
+    // Moves the current time forward to the next sample boundary (less than one sample).
+    // Rendering the same frames after a snap always produces the same samples.
+    fn snap(&mut self) {
+        self.cur_time = self.cur_sample as f64 * self.time_per_sample;
+    }
+}
+
+// struct that holds mapped points of a frame and the distance traveled to reach each point
+// positions are stored channel by channel (all values of channel 0, then channel 1, ...) and the buffers
+// are reused across frames
+#[derive(Debug, Clone)]
+struct FramePoints {
+    len: usize,
+    pos: Vec<f64>,
+    dist: Vec<f64>,
+}
+
+impl FramePoints {
+    fn new() -> FramePoints {
+        FramePoints {
+            len: 0,
+            pos: vec![],
+            dist: vec![],
+        }
+    }
+
+    fn channel(&self, channel: usize) -> &[f64] {
+        &self.pos[channel * self.len..(channel + 1) * self.len]
+    }
+
+    // room for len points of the given amount of channels, all distances are 0
+    fn reset(&mut self, channels: usize, len: usize) {
+        self.len = len;
+        self.pos.resize(channels * len, 0.0);
+        self.dist.clear();
+        self.dist.resize(len, 0.0);
+    }
+
+    // maps the points of a frame starting at cur_pos, one channel after the other
+    fn map(&mut self, points: &[SimplePoint], channels: &[MapConfiguration], cur_pos: &[f64]) {
+        let len = points.len();
+        self.reset(channels.len(), len);
+
+        if len == 0 {
+            return;
+        }
+
+        for (i, mc) in channels.iter().enumerate() {
+            let pos = &mut self.pos[i * len..(i + 1) * len];
+
+            (mc.mapper)(points, pos);
+
+            if mc.is_axis {
+                // squared distance to the previous point (or cur_pos for the first one)
+                let d = cur_pos[i] - pos[0];
+                self.dist[0] += d * d;
+                for (dist, pos) in self.dist[1..].iter_mut().zip(pos.windows(2)) {
+                    let d = pos[0] - pos[1];
+                    *dist += d * d;
+                }
+            }
+        }
+
+        for dist in self.dist.iter_mut() {
+            *dist = dist.sqrt();
+        }
+    }
+}
+
+// Points with a smaller distance may be merged when a frame does not fit, the distance doubles until it
+// fits or reaches 1/32 of the axis range
+const MERGE_DISTANCE: f64 = 1.0 / 512.0;
+const MAX_MERGE_DOUBLINGS: usize = 4;
+
+// time to move to a point and time to stay at it
+#[derive(Debug, Clone)]
+struct Step {
+    point: usize,
+    travel: f64,
+    dwell: f64,
+}
+
+// Limits of the galvos, distances in axis units (-1~1)
+#[derive(Debug, Clone)]
+struct Motion {
+    max_speed: f64,
+    acceleration: f64,
+    // seconds at a turn back
+    corner_dwell: f64,
+}
+
+// Schedules the points of a frame within the limits of the galvos.
+// The speed at every point is limited by the turn the beam takes there (full speed straight on, a stop at
+// a turn back) and by how fast the galvos can accelerate towards and brake from it. Every move takes at
+// least the time this speed profile needs. Time that is left in the frame is shared by distance.
+#[derive(Debug, Clone)]
+struct MotionPlanner {
+    motion: Motion,
+    // channels that move the beam and channels that only change how a point looks
+    axes: Vec<usize>,
+    looks: Vec<usize>,
+    // reused across frames
+    kept: Vec<usize>,
+    // moves towards the kept points, one axis after the other
+    delta: Vec<f64>,
+    dist: Vec<f64>,
+    turn: Vec<f64>,
+    speed: Vec<f64>,
+}
+
+impl MotionPlanner {
+    fn new(motion: Motion, channels: &[MapConfiguration]) -> MotionPlanner {
+        MotionPlanner {
+            motion,
+            axes: (0..channels.len())
+                .filter(|i| channels[*i].is_axis)
+                .collect(),
+            looks: (0..channels.len())
+                .filter(|i| !channels[*i].is_axis)
+                .collect(),
+            kept: vec![],
+            delta: vec![],
+            dist: vec![],
+            turn: vec![],
+            speed: vec![],
+        }
+    }
+
+    fn plan(
+        &mut self,
+        points: &FramePoints,
+        cur_pos: &[f64],
+        time_per_frame: f64,
+        guaranteed: f64,
+        steps: &mut Vec<Step>,
+    ) {
+        self.kept.clear();
+        self.kept.extend(0..points.len);
+
+        let mut merge_distance = 0.0;
+        let mut total = 0.0;
+        for merges in 0..=MAX_MERGE_DOUBLINGS {
+            total = self.schedule(points, cur_pos, guaranteed);
+
+            if total <= time_per_frame || merges == MAX_MERGE_DOUBLINGS {
+                break;
+            }
+
+            // merge a point into the next one if it is close to the previous point and looks the same
+            merge_distance = if merge_distance == 0.0 {
+                MERGE_DISTANCE
+            } else {
+                merge_distance * 2.0
+            };
+
+            let mut previous = None;
+            let axes = &self.axes;
+            let looks = &self.looks;
+            self.kept.retain(|&p| {
+                let last = p + 1 == points.len;
+                let same_look = !last
+                    && looks.iter().all(|&i| {
+                        let channel = points.channel(i);
+                        channel[p] == channel[p + 1]
+                    });
+                let dist = axes
+                    .iter()
+                    .map(|&axis| {
+                        let channel = points.channel(axis);
+                        let from = previous.map_or(cur_pos[axis], |q| channel[q]);
+                        (channel[p] - from).powi(2)
+                    })
+                    .sum::<f64>()
+                    .sqrt();
+
+                let keep = last || !same_look || dist >= merge_distance;
+                if keep {
+                    previous = Some(p);
+                }
+                keep
+            });
+
+            // a pass that merged nothing does not end the search, the next one merges over twice the
+            // distance; only the last point is left when there is nothing more to merge
+            if self.kept.len() <= 1 {
+                break;
+            }
+        }
+
+        let spare = (time_per_frame - total).max(0.0);
+        let total_dist: f64 = self.dist.iter().sum();
+
+        steps.clear();
+        for (k, point) in self.kept.iter().enumerate() {
+            let share = if total_dist > 0.0 {
+                self.dist[k] / total_dist
+            } else {
+                1.0 / self.kept.len() as f64
+            };
+
+            steps.push(Step {
+                point: *point,
+                travel: self.speed_time(k) + spare * share,
+                dwell: self.dwell(k, guaranteed),
+            });
+        }
+    }
+
+    // Computes distances, turns and speeds of the kept points, returns the least time the frame takes.
+    fn schedule(&mut self, points: &FramePoints, cur_pos: &[f64], guaranteed: f64) -> f64 {
+        let len = self.kept.len();
+        let kept = &self.kept;
+
+        self.delta.clear();
+        for &axis in &self.axes {
+            let channel = points.channel(axis);
+            let mut from = cur_pos[axis];
+            for &p in kept {
+                self.delta.push(channel[p] - from);
+                from = channel[p];
+            }
+        }
+
+        let axes = self.axes.len();
+        let delta = &self.delta;
+        self.dist.clear();
+        self.dist.extend((0..len).map(|k| {
+            (0..axes)
+                .map(|a| delta[a * len + k].powi(2))
+                .sum::<f64>()
+                .sqrt()
+        }));
+
+        // turn at a point between the move towards it and the move away from it. Points at the same
+        // position (ILDA repeats corner points) all take the turn between the moves around them.
+        // The beam starts at rest and stops at the end.
+        let dist = &self.dist;
+        self.turn.clear();
+        self.turn.resize(len, 0.0);
+        let mut incoming: Option<usize> = None;
+        for k in 0..len {
+            if dist[k] == 0.0 {
+                continue;
+            }
+            if let Some(i) = incoming {
+                let dot: f64 = (0..axes)
+                    .map(|a| delta[a * len + i] * delta[a * len + k])
+                    .sum();
+                let turn = (dot / (dist[i] * dist[k])).max(-1.0).min(1.0).acos();
+                for t in &mut self.turn[i..k] {
+                    *t = turn;
+                }
+            }
+            incoming = Some(k);
+        }
+        let stop = incoming.unwrap_or_else(|| len.saturating_sub(1));
+        for t in &mut self.turn[stop..] {
+            *t = PI;
+        }
+
+        // highest speed at every point, forward for accelerating and backward for braking
+        let max_speed = self.motion.max_speed;
+        let acceleration = self.motion.acceleration;
+        self.speed.clear();
+        self.speed.extend(
+            self.turn
+                .iter()
+                .map(|turn| max_speed * (1.0 + turn.cos()) / 2.0),
+        );
+        // without an acceleration limit the speed only depends on the turns
+        if acceleration.is_finite() {
+            let mut speed = 0.0;
+            for k in 0..len {
+                speed =
+                    self.speed[k].min((speed * speed + 2.0 * acceleration * self.dist[k]).sqrt());
+                self.speed[k] = speed;
+            }
+            for k in (0..len.saturating_sub(1)).rev() {
+                let next = self.speed[k + 1];
+                self.speed[k] =
+                    self.speed[k].min((next * next + 2.0 * acceleration * self.dist[k + 1]).sqrt());
+            }
+        }
+
+        (0..len)
+            .map(|k| self.speed_time(k) + self.dwell(k, guaranteed))
+            .sum::<f64>()
+    }
+
+    // least time of the move to the k-th kept point: accelerate, cruise, brake
+    fn speed_time(&self, k: usize) -> f64 {
+        let dist = self.dist[k];
+        if dist == 0.0 {
+            return 0.0;
+        }
+
+        let from = if k == 0 { 0.0 } else { self.speed[k - 1] };
+        let to = self.speed[k];
+        let max_speed = self.motion.max_speed;
+        let acceleration = self.motion.acceleration;
+
+        if acceleration.is_infinite() {
+            return dist / max_speed;
+        }
+
+        let peak =
+            max_speed.min(((2.0 * acceleration * dist + from * from + to * to) / 2.0).sqrt());
+        let ramps = (2.0 * peak * peak - from * from - to * to) / (2.0 * acceleration);
+
+        (peak - from) / acceleration + (peak - to) / acceleration + (dist - ramps).max(0.0) / peak
+    }
+
+    // time at the k-th kept point, the corner dwell is taken once at the last of the points at a corner
+    fn dwell(&self, k: usize, guaranteed: f64) -> f64 {
+        let corner = k + 1 == self.kept.len() || self.dist[k + 1] > 0.0;
+        if corner {
+            guaranteed + self.motion.corner_dwell * self.turn[k] / PI
+        } else {
+            guaranteed
+        }
+    }
+}
+
+// Renders frames to interleaved samples.
+// The beam position and the wav time are kept from one frame to the next.
+#[derive(Clone)]
+pub struct Renderer {
+    channels: Vec<MapConfiguration>,
+    layout: LayoutMapper,
+    time_per_frame: f64,
+    guaranteed_per_sample: f64,
+    state: RenderState,
+    plan: Plan,
+    planner: Option<MotionPlanner>,
+    stats: Option<Arc<Stats>>,
+}
+
+// where the rendering of the next frame starts
+#[derive(Clone)]
+struct RenderState {
+    progress: WavProgress,
+    cur_pos: Vec<f64>,
+}
+
+// the mapped points of a frame and the steps that draw them
+#[derive(Clone)]
+struct Plan {
+    points: FramePoints,
+    steps: Vec<Step>,
+}
+
+impl Plan {
+    fn new() -> Plan {
+        Plan {
+            points: FramePoints::new(),
+            steps: vec![],
+        }
+    }
+}
+
+impl RenderState {
+    // Advances through the steps of plan and appends their samples to samples, if given.
+    // Returns the amount of samples per channel and the amount of points that got at least one sample.
+    fn advance(
+        &mut self,
+        channel_configs: &[MapConfiguration],
+        plan: &Plan,
+        mut samples: Option<&mut Vec<f64>>,
+    ) -> (u64, usize) {
+        let channels = channel_configs.len();
+        let points = &plan.points;
+        let progress = &mut self.progress;
+        let cur_pos = &mut self.cur_pos;
+        let first_sample = progress.cur_sample;
+
+        // points that got at least one sample of their own
+        let mut drawn = 0;
+
+        for step in plan.steps.iter() {
+            let p = step.point;
+            let n = progress.advance(step.travel);
+            let travel_samples = n;
+
+            if let (true, Some(samples)) = (n > 0, samples.as_mut()) {
+                let start = samples.len();
+                samples.resize(start + n as usize * channels, 0.0);
+                let block = &mut samples[start..];
+
+                // axis channels move linearly towards the next point, other channels jump
+                for (i, mc) in channel_configs.iter().enumerate() {
+                    let next_pos = points.channel(i)[p];
+                    if mc.is_axis {
+                        let from = cur_pos[i];
+                        let step = (next_pos - from) / n as f64;
+                        for (j, sample) in block.chunks_exact_mut(channels).enumerate() {
+                            sample[i] = from + step * (j + 1) as f64;
+                        }
+                    } else {
+                        for sample in block.chunks_exact_mut(channels) {
+                            sample[i] = next_pos;
+                        }
+                    }
+                }
+            }
+
+            for (i, pos) in cur_pos.iter_mut().enumerate() {
+                *pos = points.channel(i)[p];
+            }
+
+            let n = progress.advance(step.dwell);
+
+            if let Some(samples) = samples.as_mut() {
+                for _ in 1..=n {
+                    samples.extend_from_slice(cur_pos);
+                }
+            }
+
+            if travel_samples + n > 0 {
+                drawn += 1;
+            }
+        }
+
+        (progress.cur_sample - first_sample, drawn)
+    }
+}
+
+impl Renderer {
+    fn new(
+        channels: Vec<MapConfiguration>,
+        layout: LayoutMapper,
+        fps: f64,
+        pps: f64,
+        correctness: f64,
+        motion: Option<Motion>,
+        sample_rate: u32,
+    ) -> Renderer {
+        let time_per_frame = 1.0 / fps;
+        let time_per_sample = 1.0 / sample_rate as f64;
+        let time_per_point = 1.0 / pps;
+
+        // TODO: think about this more... -> make this editable
+        // each point can use at least one sample time
+        let guaranteed_per_sample = time_per_point * correctness;
+
+        let cur_pos = vec![0.0; channels.len()];
+
+        let planner = motion.map(|motion| MotionPlanner::new(motion, &channels));
+
+        Renderer {
+            channels,
+            layout,
+            time_per_frame,
+            guaranteed_per_sample,
+            state: RenderState {
+                progress: WavProgress {
+                    cur_time: 0.0,
+                    cur_sample: 0,
+                    time_per_sample,
+                },
+                cur_pos,
+            },
+            plan: Plan::new(),
+            planner,
+            stats: None,
+        }
+    }
+
+    // The same renderer, but mapping channel by channel even if the layout has a kernel of its own.
+    pub fn per_channel(&self) -> Renderer {
+        Renderer {
+            layout: FramePoints::map,
+            ..self.clone()
+        }
+    }
+
+    // maps the points of frame without timing or rendering them
+    pub fn map(&mut self, frame: &Frame) {
+        (self.layout)(
+            &mut self.plan.points,
+            frame.get_points(),
+            &self.channels,
+            &self.state.cur_pos,
+        );
+    }
+
+    // appends the samples of frame to samples
+    pub fn render(&mut self, frame: &Frame, samples: &mut Vec<f64>) {
+        self.process(frame, Some(samples));
+    }
+
+    // advances like render without producing any samples and returns the amount of samples per channel
+    pub fn count(&mut self, frame: &Frame) -> u64 {
+        self.process(frame, None)
+    }
+
+    // Maps frame into plan and schedules its points from the current state, without advancing it.
+    fn plan(&mut self, frame: &Frame, plan: &mut Plan) {
+        let points = &mut plan.points;
+        let steps = &mut plan.steps;
+        let cur_pos = &self.state.cur_pos;
+
+        (self.layout)(points, frame.get_points(), &self.channels, cur_pos);
+
+        match self.planner.as_mut() {
+            Some(planner) => planner.plan(
+                points,
+                cur_pos,
+                self.time_per_frame,
+                self.guaranteed_per_sample,
+                steps,
+            ),
+            None => {
+                let total_dist: f64 = points.dist.iter().sum();
+
+                let guaranteed_time = self.guaranteed_per_sample * points.len as f64;
+                let shared_time = (self.time_per_frame - guaranteed_time).max(0.0);
+
+                steps.clear();
+                for p in 0..points.len {
+                    // moving to this point can use this amount of time of the shared_time
+                    // (all of the points at the same position share it evenly)
+                    let share_of_frame = if total_dist > 0.0 {
+                        points.dist[p] / total_dist
+                    } else {
+                        1.0 / points.len as f64
+                    };
+
+                    steps.push(Step {
+                        point: p,
+                        travel: shared_time * share_of_frame,
+                        dwell: self.guaranteed_per_sample,
+                    });
+                }
+            }
+        }
+    }
+
+    // statistics of a frame that plan rendered to n samples per channel, drawn of its points got samples
+    fn rendered(&self, stats: &Stats, plan: &Plan, n: u64, drawn: usize) {
+        let len = plan.points.len;
+        stats.frame(len);
+        stats.dropped_points(len.saturating_sub(drawn));
+        // more than a sample longer than a frame should take
+        if (n as f64 - 1.0) * self.state.progress.time_per_sample > self.time_per_frame {
+            stats.over_budget();
+        }
+    }
+
+    fn process(&mut self, frame: &Frame, samples: Option<&mut Vec<f64>>) -> u64 {
+        // counting passes are not part of the statistics
+        let stats = self.stats.clone().filter(|_| samples.is_some());
+        let mut timer = StageTimer::new(stats.as_deref());
+
+        // the plan is taken out while the renderer plans into it, its buffers stay
+        let mut plan = mem::replace(&mut self.plan, Plan::new());
+
+        self.plan(frame, &mut plan);
+        timer.lap(Stage::Map);
+
+        let (n, drawn) = self.state.advance(&self.channels, &plan, samples);
+
+        if let Some(stats) = &stats {
+            timer.lap(Stage::Render);
+            self.rendered(stats, &plan, n, drawn);
+        }
+
+        self.plan = plan;
+        n
+    }
+}
+
+// First pass over a finite input, counts the samples per channel that rendering it will produce.
+fn count_samples(
+    input: &FrameInput,
+    filename: &str,
+    range: Range<usize>,
+    renderer: &Renderer,
+) -> u64 {
+    let mut renderer = renderer.clone();
+    let source = match input {
+        FrameInput::Read(Source::Indexed(animation)) => Source::Indexed(animation.clone()),
+        _ => Source::Stream(Input::open(filename).expect("Failed to open file.")),
+    };
+    let mut input = FrameInput::Read(source);
+
+    frames(&mut input, range, false)
+        .map(|frame| renderer.count(&frame))
+        .sum()
+}
+
+fn frames<'a>(
+    input: &'a mut FrameInput,
+    range: Range<usize>,
+    repeat: bool,
+) -> Box<dyn Iterator<Item = Arc<Frame>> + 'a> {
+    let frames: Box<dyn Iterator<Item = Frame> + 'a> = match input {
+        FrameInput::Read(Source::Stream(input)) => Box::new(
+            Animation::stream(input)
+                .skip(range.start)
+                .take(range.end - range.start),
+        ),
+        FrameInput::Read(Source::Indexed(animation)) => Box::new(animation.clone().frames(range)),
+        FrameInput::Produced(frames) => Box::new(
+            frames
+                .iter()
+                .skip(range.start)
+                .take(range.end - range.start),
+        ),
+    };
+
+    if repeat {
+        Box::new(frames.memory_cycle())
+    } else {
+        Box::new(frames.map(Arc::new))
+    }
+}
+
+// Frames of a render pass. Indexed frames are decoded by the workers of a parallel pass.
+enum Frames<'a> {
+    Decoded(Box<dyn Iterator<Item = Arc<Frame>> + 'a>),
+    Indexed(Arc<IndexedAnimation>, Range<usize>),
+}
+
+// Pushes samples into a ring buffer, blocks while it is full.
+// Fails with BrokenPipe once the consumer is gone.
+struct RingWriter {
+    producer: Producer<f64>,
+}
+
+impl SampleWrite for RingWriter {
+    fn write(&mut self, samples: &[f64]) -> Result<(), IoError> {
+        let mut pushed = self.producer.push_slice(samples);
+        while pushed < samples.len() {
+            if self.producer.is_abandoned() {
+                return Err(IoError::from(ErrorKind::BrokenPipe));
+            }
+            thread::sleep(Duration::from_millis(1));
+            pushed += self.producer.push_slice(&samples[pushed..]);
+        }
+        Ok(())
+    }
+
+    fn finish(self: Box<Self>) -> Result<(), IoError> {
+        Ok(())
+    }
+}
+
+// Yields the frames of the first loop of a cached animation and records them for the next loops, until
+// they no longer fit into budget. The frame that exceeds it is the last one.
+struct Recording<I> {
+    frames: I,
+    recorded: Vec<Arc<Frame>>,
+    // of the recorded frames, in samples like the budget
+    size: usize,
+    budget: usize,
+}
+
+impl<I: Iterator<Item = Arc<Frame>>> Iterator for Recording<I> {
+    type Item = Arc<Frame>;
+
+    fn next(&mut self) -> Option<Arc<Frame>> {
+        if self.size > self.budget {
+            return None;
+        }
+
+        let frame = self.frames.next()?;
+        let bytes = frame.get_points().len() * mem::size_of::<SimplePoint>();
+        self.size += (bytes + mem::size_of::<f64>() - 1) / mem::size_of::<f64>();
+        self.recorded.push(frame.clone());
+        Some(frame)
+    }
+}
+
+// Records the samples of one loop of the animation while passing them on.
+// Gives up (and frees the recording) once it holds more than budget samples.
+struct CycleCache<'a> {
+    output: &'a mut dyn SampleWrite,
+    budget: usize,
+    samples: Vec<f64>,
+    // where each written block ends in samples, so that replaying keeps the block sizes
+    blocks: Vec<usize>,
+    overflow: bool,
+}
+
+impl<'a> SampleWrite for CycleCache<'a> {
+    fn write(&mut self, samples: &[f64]) -> Result<(), IoError> {
+        self.output.write(samples)?;
+
+        if !self.overflow {
+            if self.samples.len() + samples.len() > self.budget {
+                self.overflow = true;
+                self.samples = vec![];
+                self.blocks = vec![];
+            } else {
+                self.samples.extend_from_slice(samples);
+                self.blocks.push(self.samples.len());
+            }
+        }
+
+        Ok(())
+    }
+
+    fn finish(self: Box<Self>) -> Result<(), IoError> {
+        Ok(())
+    }
+}
+
+// Writes through to the output and records the samples and the time it takes.
+struct StatsWriter {
+    output: Box<dyn SampleWrite>,
+    stats: Arc<Stats>,
+    channels: usize,
+}
+
+impl SampleWrite for StatsWriter {
+    fn write(&mut self, samples: &[f64]) -> Result<(), IoError> {
+        let mut timer = StageTimer::new(Some(&self.stats));
+        self.output.write(samples)?;
+        timer.lap(Stage::Write);
+        self.stats.samples(samples.len() / self.channels);
+        Ok(())
+    }
+
+    fn finish(self: Box<Self>) -> Result<(), IoError> {
+        self.output.finish()
+    }
+}
+
+// Renders frames serially or on a pool of worker threads.
+fn render_pass(
+    frames: Frames,
+    renderer: &mut Renderer,
+    output: &mut dyn SampleWrite,
+    jobs: Option<usize>,
+) -> Result<(), IoError> {
+    let frames = match frames {
+        Frames::Decoded(frames) => Frames::Decoded(Box::new(stats::timed(
+            frames,
+            renderer.stats.clone(),
+            Stage::Decode,
+        ))),
+        frames => frames,
+    };
+
+    match jobs {
+        Some(jobs) => render_parallel(frames, renderer, output, jobs),
+        None => {
+            let frames = match frames {
+                Frames::Decoded(frames) => frames,
+                Frames::Indexed(animation, range) => Box::new(
+                    stats::timed(
+                        animation.frames(range),
+                        renderer.stats.clone(),
+                        Stage::Decode,
+                    )
+                    .map(Arc::new),
+                ),
+            };
+
+            // interleaved samples of the current frame, reused across frames
+            let mut samples: Vec<f64> = vec![];
+
+            for frame in frames {
+                samples.clear();
+                renderer.render(&frame, &mut samples);
+
+                // one frame becomes one write
+                output.write(&samples)?;
+            }
+
+            Ok(())
+        }
+    }
+}
+
+// Renders the input, forever if repeat is set.
+// When repeating, every loop after the first one starts at the same beam position (the last point of the
+// animation). With the wav time snapped to a sample boundary, all of those loops produce the same
+// samples, so the second loop is recorded and played back from memory if it fits into cache samples.
+fn render(
+    mut input: FrameInput,
+    range: Range<usize>,
+    repeat: bool,
+    cache: usize,
+    mut renderer: Renderer,
+    output: &mut dyn SampleWrite,
+    jobs: Option<usize>,
+) -> Result<(), IoError> {
+    if !repeat {
+        let frames = match &input {
+            FrameInput::Read(Source::Indexed(animation)) => {
+                Frames::Indexed(animation.clone(), range)
+            }
+            _ => Frames::Decoded(frames(&mut input, range, false)),
+        };
+        return render_pass(frames, &mut renderer, output, jobs);
+    }
+
+    if cache == 0 {
+        let frames = Frames::Decoded(frames(&mut input, range, true));
+        return render_pass(frames, &mut renderer, output, jobs);
+    }
+
+    // the first loop starts at the origin and records its frames while they are rendered, so output starts
+    // right away even for inputs that never end
+    let mut recording = Recording {
+        frames: frames(&mut input, range, false),
+        recorded: vec![],
+        size: 0,
+        budget: cache,
+    };
+    render_pass(
+        Frames::Decoded(Box::new(&mut recording)),
+        &mut renderer,
+        output,
+        jobs,
+    )?;
+
+    let Recording {
+        frames: rest,
+        recorded: cycle,
+        size,
+        ..
+    } = recording;
+
+    // the rest of the input and every loop after it are rendered from a memory cycle, as without cache
+    if size > cache {
+        eprintln!("Animation does not fit into the cache, rendering every loop.");
+        let played = cycle.len();
+        let frames = cycle
+            .into_iter()
+            .chain(rest)
+            .memory_cycle()
+            .skip(played)
+            .map(|frame| (*frame).clone());
+        return render_pass(
+            Frames::Decoded(Box::new(frames)),
+            &mut renderer,
+            output,
+            jobs,
+        );
+    }
+    drop(rest);
+
+    let loop_frames = || Frames::Decoded(Box::new(cycle.iter().cloned()));
+
+    renderer.state.progress.snap();
+
+    // the recorded frames stay while the second loop is rendered, its samples get what they left
+    let mut recorder = CycleCache {
+        output,
+        budget: cache - size,
+        samples: vec![],
+        blocks: vec![],
+        overflow: false,
+    };
+    render_pass(loop_frames(), &mut renderer, &mut recorder, jobs)?;
+
+    let CycleCache {
+        output,
+        samples,
+        blocks,
+        overflow,
+        ..
+    } = recorder;
+
+    if overflow {
+        eprintln!("Animation does not fit into the cache, rendering every loop.");
+        loop {
+            render_pass(loop_frames(), &mut renderer, output, jobs)?;
+        }
+    }
+
+    drop(cycle);
+
+    if samples.is_empty() {
+        return Ok(());
+    }
+
+    loop {
+        let mut start = 0;
+        for end in &blocks {
+            output.write(&samples[start..*end])?;
+            start = *end;
+        }
+    }
+}
+
+// Renders on a separate thread into a ring buffer that holds latency seconds of samples.
+// This thread drains the buffer into the output in periods of a quarter of the buffer.
+fn stream(
+    input: FrameInput,
+    range: Range<usize>,
+    repeat: bool,
+    cache: usize,
+    renderer: Renderer,
+    output: &mut dyn SampleWrite,
+    latency: f64,
+    sample_rate: u32,
+) -> Result<(), IoError> {
+    let channels = renderer.channels.len();
+    let buffer_len = ((latency * sample_rate as f64).ceil() as usize).max(4) * channels;
+    let period = buffer_len / 4 / channels * channels;
+
+    let (producer, mut consumer) = ring_buffer(buffer_len);
+
+    let render_thread = thread::spawn(move || {
+        // the only possible error is the output side being gone
+        let _ = render(
+            input,
+            range,
+            repeat,
+            cache,
+            renderer,
+            &mut RingWriter { producer },
+            None,
+        );
+    });
+
+    let to_ms = |len: usize| len as f64 * 1000.0 / (channels as f64 * sample_rate as f64);
+
+    // fill the buffer before starting the output
+    while consumer.len() < buffer_len && !consumer.is_closed() {
+        thread::sleep(Duration::from_millis(1));
+    }
+
+    let mut chunk = vec![0.0; period];
+    let mut underruns = 0;
+    let mut written = 0;
+    let mut next_report = sample_rate as usize * channels;
+
+    loop {
+        if consumer.len() < period && !consumer.is_closed() {
+            underruns += 1;
+            while consumer.len() < period && !consumer.is_closed() {
+                thread::sleep(Duration::from_millis(1));
+            }
+        }
+
+        let n = consumer.pop_slice(&mut chunk);
+        if n == 0 {
+            break;
+        }
+
+        output.write(&chunk[..n])?;
+
+        // report about once per second of output
+        written += n;
+        if written >= next_report {
+            next_report += sample_rate as usize * channels;
+            eprintln!(
+                "Buffer: {:.0}/{:.0} ms, underruns: {}",
+                to_ms(consumer.len()),
+                to_ms(buffer_len),
+                underruns
+            );
+        }
+    }
+
+    render_thread.join().expect("Render thread panicked.");
+
+    Ok(())
+}
+
+// The buffers of a frame on its way through the workers: planned by the sequential pass, rendered by a
+// worker, written by the main thread and then reused for a later frame.
+struct Slot {
+    plan: Plan,
+    samples: Vec<f64>,
+}
+
+impl Slot {
+    fn new() -> Slot {
+        Slot {
+            plan: Plan::new(),
+            samples: vec![],
+        }
+    }
+}
+
+// a chunk of consecutive planned frames and the state to start rendering them from
+struct Chunk {
+    // number of the first frame
+    first: usize,
+    state: RenderState,
+    frames: Vec<Slot>,
+}
+
+// work for the render threads
+enum Job {
+    // decode the frames of an indexed input
+    Decode(usize, Range<usize>),
+    Render(Chunk),
+}
+
+enum JobResult {
+    Decoded(usize, Vec<Arc<Frame>>),
+    // the samples of a single frame
+    Rendered(usize, Slot),
+}
+
+const FRAMES_PER_CHUNK: usize = 8;
+
+// Renders frames on a pool of worker threads.
+// A sequential pass maps and plans every frame once and advances the timing through it without
+// producing samples, which gives the state each chunk of frames starts from. The workers turn the
+// planned frames into samples from there and hand back every frame as soon as it is done. Frames are
+// written in order, so the output is identical to rendering on a single thread.
+// Indexed frames are decoded by the workers as well, chunk by chunk ahead of the sequential pass.
+fn render_parallel(
+    frames: Frames,
+    renderer: &mut Renderer,
+    output: &mut dyn SampleWrite,
+    jobs: usize,
+) -> Result<(), IoError> {
+    let (job_sender, job_receiver) = mpsc::channel::<Job>();
+    let job_receiver = Arc::new(Mutex::new(job_receiver));
+    let (result_sender, result_receiver) = mpsc::channel::<JobResult>();
+
+    let animation = match &frames {
+        Frames::Indexed(animation, _) => Some(animation.clone()),
+        Frames::Decoded(_) => None,
+    };
+
+    let workers: Vec<_> = (0..jobs)
+        .map(|_| {
+            let queue = job_receiver.clone();
+            let results = result_sender.clone();
+            let animation = animation.clone();
+            let mut renderer = renderer.clone();
+
+            thread::spawn(move || loop {
+                let job = match queue.lock().unwrap().recv() {
+                    Ok(job) => job,
+                    Err(_) => break,
+                };
+
+                match job {
+                    Job::Decode(index, range) => {
+                        let animation = animation.clone().expect("Input is not indexed.");
+                        let frames = animation.frames(range);
+                        let frames = stats::timed(frames, renderer.stats.clone(), Stage::Decode);
+                        let result = JobResult::Decoded(index, frames.map(Arc::new).collect());
+                        if results.send(result).is_err() {
+                            break;
+                        }
+                    }
+                    Job::Render(chunk) => {
+                        renderer.state = chunk.state;
+
+                        for (i, mut slot) in chunk.frames.into_iter().enumerate() {
+                            let mut timer = StageTimer::new(renderer.stats.as_deref());
+
+                            slot.samples.clear();
+                            let (n, drawn) = renderer.state.advance(
+                                &renderer.channels,
+                                &slot.plan,
+                                Some(&mut slot.samples),
+                            );
+
+                            if let Some(stats) = &renderer.stats {
+                                timer.lap(Stage::Render);
+                                renderer.rendered(stats, &slot.plan, n, drawn);
+                            }
+
+                            if results
+                                .send(JobResult::Rendered(chunk.first + i, slot))
+                                .is_err()
+                            {
+                                return;
+                            }
+                        }
+                    }
+                }
+            })
+        })
+        .collect();
+
+    drop(result_sender);
+
+    // frame ranges of the indexed input that still have to be decoded
+    let (mut decoded_frames, mut ranges) = match frames {
+        Frames::Decoded(frames) => (Some(frames.fuse()), 0..0),
+        Frames::Indexed(animation, range) => (None, range.start..range.end.min(animation.len())),
+    };
+    let mut decoded = BTreeMap::new();
+    let mut requested = 0;
+
+    let mut pending = BTreeMap::new();
+    // buffers of written frames
+    let mut spare = vec![];
+    // chunks sent to the workers, frames in them and frames written
+    let mut sent = 0;
+    let mut sent_frames = 0;
+    let mut written = 0;
+    let mut finished = false;
+
+    loop {
+        // decode a few chunks ahead of the sequential pass
+        while !ranges.is_empty() && requested < sent + jobs * 2 {
+            let end = ranges.end.min(ranges.start + FRAMES_PER_CHUNK);
+            job_sender
+                .send(Job::Decode(requested, ranges.start..end))
+                .expect("Render thread panicked.");
+            ranges.start = end;
+            requested += 1;
+        }
+
+        // keep all workers busy, but bound the amount of samples that wait to be written
+        while !finished && sent_frames - written < jobs * 2 * FRAMES_PER_CHUNK {
+            let chunk: Vec<_> = match &mut decoded_frames {
+                Some(frames) => frames.by_ref().take(FRAMES_PER_CHUNK).collect(),
+                None => match decoded.remove(&sent) {
+                    Some(chunk) => chunk,
+                    None if sent == requested => vec![],
+                    // wait for the decoder
+                    None => break,
+                },
+            };
+
+            // a short chunk is the last one, indexed frames that fail to decode end the input
+            finished = chunk.len() < FRAMES_PER_CHUNK;
+            if chunk.is_empty() {
+                break;
+            }
+
+            let state = renderer.state.clone();
+            let stats = renderer.stats.clone();
+            let slots: Vec<_> = chunk
+                .iter()
+                .map(|frame| {
+                    let mut slot = spare.pop().unwrap_or_else(Slot::new);
+                    let mut timer = StageTimer::new(stats.as_deref());
+                    renderer.plan(frame, &mut slot.plan);
+                    timer.lap(Stage::Map);
+                    renderer.state.advance(&renderer.channels, &slot.plan, None);
+                    slot
+                })
+                .collect();
+
+            let len = slots.len();
+            job_sender
+                .send(Job::Render(Chunk {
+                    first: sent_frames,
+                    state,
+                    frames: slots,
+                }))
+                .expect("Render thread panicked.");
+            sent += 1;
+            sent_frames += len;
+        }
+
+        if finished {
+            ranges.start = ranges.end;
+            if written == sent_frames {
+                break;
+            }
+        }
+
+        match result_receiver.recv().expect("Render thread panicked.") {
+            JobResult::Decoded(index, frames) => {
+                decoded.insert(index, frames);
+            }
+            JobResult::Rendered(index, slot) => {
+                pending.insert(index, slot);
+            }
+        }
+
+        while let Some(slot) = pending.remove(&written) {
+            output.write(&slot.samples)?;
+            written += 1;
+            spare.push(slot);
+        }
+
+        if let Some(stats) = &renderer.stats {
+            stats.queue(sent_frames - written);
+        }
+    }
+
+    drop(job_sender);
+
+    for worker in workers {
+        worker.join().expect("Render thread panicked.");
+    }
+
+    Ok(())
+}
+
+// Renders with the given options until the input ends.
+pub fn run(options: Options) {
+    let Options {
+        input,
+        range,
+        mut output,
+        renderer,
+        repeat,
+        cache,
+        latency,
+        jobs,
+        sample_rate,
+        stats,
+        ..
+    } = options;
+
+    match latency {
+        Some(latency) => stream(
+            input,
+            range,
+            repeat,
+            cache,
+            renderer,
+            &mut *output,
+            latency,
+            sample_rate,
+        )
+        .unwrap(),
+        None => render(input, range, repeat, cache, renderer, &mut *output, jobs).unwrap(),
+    }
+
+    output.finish().unwrap();
+
+    // the last interval
+    if let Some(stats) = stats {
+        stats.report();
+    }
+}
+
+// how many frames a producer can be ahead of its renderer
+const PRODUCED_FRAMES: usize = 4;
+
+// Hands the frames of a producer to a renderer on a separate thread, without encoding them as ILDA.
+pub struct FrameSender {
+    sender: SyncSender<Frame>,
+    renderer: thread::JoinHandle<()>,
+}
+
+impl FrameSender {
+    // Starts a renderer with the given ilda2wav arguments, they are split at whitespace.
+    pub fn spawn(args: &str) -> FrameSender {
+        let args: Vec<String> = iter::once("ilda2wav")
+            .chain(args.split_whitespace())
+            .map(String::from)
+            .collect();
+        let (sender, receiver) = mpsc::sync_channel(PRODUCED_FRAMES);
+
+        // audio devices have to stay on the thread that opened them
+        let renderer = thread::spawn(move || run(get_options(args, Some(receiver))));
+
+        FrameSender { sender, renderer }
+    }
+
+    // Fails once the renderer is gone.
+    pub fn send(&self, frame: Frame) -> Result<(), IoError> {
+        self.sender
+            .send(frame)
+            .map_err(|_| IoError::new(ErrorKind::BrokenPipe, "The renderer stopped."))
+    }
+
+    // Waits until all sent frames are rendered.
+    pub fn finish(self) {
+        drop(self.sender);
+        self.renderer.join().expect("Render thread panicked.");
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const GUARANTEED: f64 = 1e-5;
+
+    fn planner(acceleration: f64) -> MotionPlanner {
+        MotionPlanner::new(
+            Motion {
+                max_speed: 100.0,
+                acceleration,
+                corner_dwell: 1e-3,
+            },
+            &[
+                channel::<AxisX>(),
+                channel::<AxisY>(),
+                channel::<Blanking>(),
+            ],
+        )
+    }
+
+    // points at the given positions, all drawn, channel after channel like FramePoints::map
+    fn points(positions: &[(f64, f64)]) -> FramePoints {
+        let mut points = FramePoints::new();
+        points.reset(3, positions.len());
+        for (p, (x, y)) in positions.iter().enumerate() {
+            points.pos[p] = *x;
+            points.pos[positions.len() + p] = *y;
+        }
+        points
+    }
+
+    // a square that repeats every corner, as ILDA files do to make the beam wait there
+    fn square() -> FramePoints {
+        points(&[
+            (0.5, 0.0),
+            (0.5, 0.0),
+            (0.5, 0.5),
+            (0.5, 0.5),
+            (0.0, 0.5),
+            (0.0, 0.5),
+            (0.0, 0.0),
+        ])
+    }
+
+    fn plan(planner: &mut MotionPlanner, points: &FramePoints) -> Vec<Step> {
+        let mut steps = vec![];
+        planner.plan(points, &[0.0; 3], 1.0, GUARANTEED, &mut steps);
+        steps
+    }
+
+    #[test]
+    fn axes_are_split_from_looks() {
+        let planner = planner(1000.0);
+        assert_eq!(planner.axes, vec![0, 1]);
+        assert_eq!(planner.looks, vec![2]);
+    }
+
+    #[test]
+    fn repeated_corner_points_share_the_turn() {
+        let mut planner = planner(1000.0);
+        let steps = plan(&mut planner, &square());
+
+        for k in 0..6 {
+            assert!((planner.turn[k] - PI / 2.0).abs() < 1e-9, "turn {}", k);
+        }
+        assert_eq!(planner.turn[6], PI);
+
+        // the beam is as slow at the repeated point as at the corner itself
+        assert!((planner.speed[0] - planner.speed[1]).abs() < 1e-9);
+        assert!(planner.speed[2] <= 50.0 + 1e-9);
+
+        // the corner dwell is taken once per corner, at the repeated point
+        let corner = GUARANTEED + 1e-3 / 2.0;
+        for (k, step) in steps.iter().enumerate() {
+            let dwell = match k {
+                0 | 2 | 4 => GUARANTEED,
+                6 => GUARANTEED + 1e-3,
+                _ => corner,
+            };
+            assert!((step.dwell - dwell).abs() < 1e-12, "dwell {}", k);
+        }
+    }
+
+    #[test]
+    fn straight_lines_do_not_turn() {
+        let mut planner = planner(1000.0);
+        plan(
+            &mut planner,
+            &points(&[(0.25, 0.0), (0.25, 0.0), (0.5, 0.0), (0.75, 0.0)]),
+        );
+
+        assert_eq!(&planner.turn[..3], &[0.0; 3]);
+        assert_eq!(planner.turn[3], PI);
+    }
+
+    #[test]
+    fn infinite_acceleration_with_repeated_points() {
+        let mut planner = planner(std::f64::INFINITY);
+        let steps = plan(&mut planner, &square());
+
+        // only the turns limit the speed
+        for (speed, turn) in planner.speed.iter().zip(&planner.turn) {
+            assert!((speed - 100.0 * (1.0 + turn.cos()) / 2.0).abs() < 1e-9);
+        }
+        for step in &steps {
+            assert!(step.travel.is_finite() && step.dwell.is_finite());
+        }
+        // the moves take no longer than at full speed, repeated points take no time
+        assert!((planner.speed_time(0) - 0.5 / 100.0).abs() < 1e-12);
+        assert_eq!(planner.speed_time(1), 0.0);
+    }
+
+    #[test]
+    fn points_at_the_current_position() {
+        let mut planner = planner(std::f64::INFINITY);
+        let steps = plan(&mut planner, &points(&[(0.0, 0.0), (0.0, 0.0)]));
+
+        // the beam does not move, it stops at the end
+        assert_eq!(planner.turn, vec![0.0, PI]);
+        assert_eq!(steps[0].dwell, GUARANTEED);
+        assert_eq!(steps[1].dwell, GUARANTEED + 1e-3);
+
+        // there is no distance to share the time by, the points share it evenly
+        let spare = 1.0 - steps[0].dwell - steps[1].dwell;
+        for step in &steps {
+            assert!((step.travel - spare / 2.0).abs() < 1e-12);
+        }
+    }
+}
@@ -0,0 +1,125 @@
+use std::cell::UnsafeCell;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::Arc;
+
+// Bounded single producer / single consumer ring buffer.
+// Neither side ever takes a lock: the producer only moves head, the consumer only moves tail.
+struct Shared<T> {
+    buffer: Box<[UnsafeCell<T>]>,
+    mask: usize,
+    // the buffer is a power of two long, but never holds more than capacity items
+    capacity: usize,
+    head: AtomicUsize,
+    tail: AtomicUsize,
+    closed: AtomicBool,
+}
+
+unsafe impl<T: Send> Sync for Shared<T> {}
+
+pub struct Producer<T> {
+    shared: Arc<Shared<T>>,
+}
+
+pub struct Consumer<T> {
+    shared: Arc<Shared<T>>,
+}
+
+// Creates a ring buffer that holds up to capacity items.
+pub fn ring_buffer<T: Copy + Default>(capacity: usize) -> (Producer<T>, Consumer<T>) {
+    let capacity = capacity.max(1);
+    let size = capacity.next_power_of_two();
+    let buffer: Vec<_> = (0..size).map(|_| UnsafeCell::new(T::default())).collect();
+    let shared = Arc::new(Shared {
+        buffer: buffer.into_boxed_slice(),
+        mask: size - 1,
+        capacity,
+        head: AtomicUsize::new(0),
+        tail: AtomicUsize::new(0),
+        closed: AtomicBool::new(false),
+    });
+
+    (
+        Producer {
+            shared: shared.clone(),
+        },
+        Consumer { shared },
+    )
+}
+
+impl<T> Shared<T> {
+    fn capacity(&self) -> usize {
+        self.capacity
+    }
+
+    fn len(&self) -> usize {
+        let head = self.head.load(Ordering::Acquire);
+        let tail = self.tail.load(Ordering::Acquire);
+        head.wrapping_sub(tail)
+    }
+}
+
+impl<T: Copy> Producer<T> {
+    // Copies as many items as there is space for and returns that count. Never blocks.
+    pub fn push_slice(&mut self, items: &[T]) -> usize {
+        let shared = &*self.shared;
+        let head = shared.head.load(Ordering::Relaxed);
+        let tail = shared.tail.load(Ordering::Acquire);
+        let n = items.len().min(shared.capacity() - head.wrapping_sub(tail));
+
+        for (i, item) in items[..n].iter().enumerate() {
+            unsafe { *shared.buffer[head.wrapping_add(i) & shared.mask].get() = *item }
+        }
+
+        shared.head.store(head.wrapping_add(n), Ordering::Release);
+        n
+    }
+
+    pub fn len(&self) -> usize {
+        self.shared.len()
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.shared.capacity()
+    }
+
+    // true once the consumer is gone, nobody will read pushed items anymore
+    pub fn is_abandoned(&self) -> bool {
+        Arc::strong_count(&self.shared) == 1
+    }
+}
+
+impl<T> Drop for Producer<T> {
+    fn drop(&mut self) {
+        self.shared.closed.store(true, Ordering::Release);
+    }
+}
+
+impl<T: Copy> Consumer<T> {
+    // Copies as many items as are available into items and returns that count. Never blocks.
+    pub fn pop_slice(&mut self, items: &mut [T]) -> usize {
+        let shared = &*self.shared;
+        let tail = shared.tail.load(Ordering::Relaxed);
+        let head = shared.head.load(Ordering::Acquire);
+        let n = items.len().min(head.wrapping_sub(tail));
+
+        for (i, item) in items[..n].iter_mut().enumerate() {
+            *item = unsafe { *shared.buffer[tail.wrapping_add(i) & shared.mask].get() }
+        }
+
+        shared.tail.store(tail.wrapping_add(n), Ordering::Release);
+        n
+    }
+
+    pub fn len(&self) -> usize {
+        self.shared.len()
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.shared.capacity()
+    }
+
+    // true once the producer is gone, len() will not grow anymore
+    pub fn is_closed(&self) -> bool {
+        self.shared.closed.load(Ordering::Acquire)
+    }
+}
@@ -0,0 +1,185 @@
+use rustfft::num_complex::Complex;
+use rustfft::{FFTplanner, FFT};
+use std::f64::consts::PI;
+use std::sync::Arc;
+
+#[derive(Clone, Copy)]
+pub enum WindowFunction {
+    Rectangular,
+    Hann,
+    Hamming,
+    Blackman,
+}
+
+impl WindowFunction {
+    // coefficients for a window of len samples, scaled to an average of 1 so that the level of the
+    // spectrum does not depend on the window function
+    pub fn coefficients(&self, len: usize) -> Vec<f64> {
+        let coefficient = |i: usize| {
+            let x = 2.0 * PI * i as f64 / (len - 1).max(1) as f64;
+            match self {
+                WindowFunction::Rectangular => 1.0,
+                WindowFunction::Hann => 0.5 - 0.5 * x.cos(),
+                WindowFunction::Hamming => 0.54 - 0.46 * x.cos(),
+                WindowFunction::Blackman => 0.42 - 0.5 * x.cos() + 0.08 * (2.0 * x).cos(),
+            }
+        };
+
+        let coefficients: Vec<_> = (0..len).map(coefficient).collect();
+        let average = coefficients.iter().sum::<f64>() / len as f64;
+        coefficients.iter().map(|c| c / average).collect()
+    }
+}
+
+// Magnitude spectrum of a real valued window of samples.
+// The samples are packed into a complex signal of half the length (even samples as real part, odd samples
+// as imaginary part), so a single FFT of half the size covers the whole window. The spectrum of the real
+// signal is then untangled from the result. All buffers are reused from one window to the next.
+pub struct Spectrum {
+    fft: Arc<dyn FFT<f64>>,
+    coefficients: Vec<f64>,
+    // exp(-2 pi i k / len) for k in 0..len/2
+    twiddles: Vec<Complex<f64>>,
+    packed: Vec<Complex<f64>>,
+    transformed: Vec<Complex<f64>>,
+    spectrum: Vec<Complex<f64>>,
+    magnitudes: Vec<f64>,
+}
+
+impl Spectrum {
+    // len has to be even
+    pub fn new(len: usize, window_function: WindowFunction) -> Spectrum {
+        let half = len / 2;
+
+        Spectrum {
+            fft: FFTplanner::new(false).plan_fft(half),
+            coefficients: window_function.coefficients(len),
+            twiddles: (0..half)
+                .map(|k| Complex::from_polar(&1.0, &(-2.0 * PI * k as f64 / len as f64)))
+                .collect(),
+            packed: vec![Complex::new(0.0, 0.0); half],
+            transformed: vec![Complex::new(0.0, 0.0); half],
+            spectrum: vec![Complex::new(0.0, 0.0); half + 1],
+            magnitudes: vec![0.0; half + 1],
+        }
+    }
+
+    // Returns the magnitudes of the frequencies 0, 1, ..., len/2 (in multiples of sample_rate / len).
+    pub fn process(&mut self, samples: &[f64]) -> &[f64] {
+        let half = self.packed.len();
+
+        for ((packed, pair), c) in self
+            .packed
+            .iter_mut()
+            .zip(samples.chunks_exact(2))
+            .zip(self.coefficients.chunks_exact(2))
+        {
+            *packed = Complex::new(pair[0] * c[0], pair[1] * c[1]);
+        }
+
+        self.fft.process(&mut self.packed, &mut self.transformed);
+
+        // even = (Z[k] + conj(Z[half - k])) / 2, odd = (Z[k] - conj(Z[half - k])) / 2i
+        // X[k] = even + exp(-2 pi i k / len) * odd
+        for (k, x) in self.spectrum.iter_mut().enumerate() {
+            let z = self.transformed[k % half];
+            let mirrored = self.transformed[(half - k) % half].conj();
+            let even = (z + mirrored) * 0.5;
+            let odd = (z - mirrored) * Complex::new(0.0, -0.5);
+            let twiddle = if k < half {
+                self.twiddles[k]
+            } else {
+                Complex::new(-1.0, 0.0)
+            };
+            *x = even + twiddle * odd;
+        }
+
+        // a single branch free pass, so that it can be vectorized
+        for (magnitude, x) in self.magnitudes.iter_mut().zip(&self.spectrum) {
+            *magnitude = (x.re * x.re + x.im * x.im).sqrt();
+        }
+
+        &self.magnitudes
+    }
+}
+
+// An equalizer bin covers the fractional index range from_index..to_index of the spectrum.
+// Its value is the average magnitude over that range: the partially covered magnitudes at both ends are
+// weighted by the covered fraction.
+struct Bin {
+    // index of the partially covered magnitude at the start and its weight
+    first: usize,
+    first_weight: f64,
+    // range of fully covered magnitudes
+    from: usize,
+    to: usize,
+    // weight of the partially covered magnitude at to
+    last_weight: f64,
+    // 1 / (to_index - from_index)
+    scale: f64,
+}
+
+// Log spaced bins from 100Hz to 20kHz.
+// The boundaries only depend on the window size, the sample rate and the amount of bins, so they are
+// computed once. Per frame, a prefix sum over the magnitudes makes every bin O(1).
+pub struct BinTable {
+    bins: Vec<Bin>,
+    // prefix[i] is the sum of the first i magnitudes
+    prefix: Vec<f64>,
+}
+
+impl BinTable {
+    pub fn new(sample_window: usize, sample_rate: u32, bins: u16) -> BinTable {
+        let from_index = (sample_window as f64 * 100.0 / sample_rate as f64).max(1.0);
+        let to_index = sample_window as f64 * (20000.0 / sample_rate as f64).min(0.5);
+
+        let log_space_from = from_index.log2();
+        let log_space_step = (to_index.log2() - log_space_from) / bins as f64;
+
+        let bins = (0..bins)
+            .map(|i| {
+                let from_index = (2.0 as f64).powf(log_space_from + i as f64 * log_space_step);
+                let to_index =
+                    (2.0 as f64).powf(log_space_from + (i as f64 + 1.0) * log_space_step);
+
+                let from_full = from_index.ceil();
+                let to_full = to_index.floor();
+
+                // if both ends are within the same magnitude, from is to + 1 and the prefix sum difference
+                // is negative, which leaves exactly that magnitude (to_index - from_index) times
+                Bin {
+                    first: from_full as usize - 1,
+                    first_weight: from_full - from_index,
+                    from: from_full as usize,
+                    to: to_full as usize,
+                    last_weight: to_index - to_full,
+                    scale: 1.0 / (to_index - from_index),
+                }
+            })
+            .collect();
+
+        BinTable {
+            bins,
+            prefix: vec![],
+        }
+    }
+
+    // Appends the value of every bin to values.
+    pub fn process(&mut self, magnitudes: &[f64], values: &mut Vec<f64>) {
+        self.prefix.clear();
+        self.prefix.push(0.0);
+        let mut sum = 0.0;
+        for magnitude in magnitudes {
+            sum += magnitude;
+            self.prefix.push(sum);
+        }
+
+        let prefix = &self.prefix;
+        values.extend(self.bins.iter().map(|bin| {
+            let sum = bin.first_weight * magnitudes[bin.first]
+                + (prefix[bin.to] - prefix[bin.from])
+                + bin.last_weight * magnitudes[bin.to];
+            sum * bin.scale
+        }));
+    }
+}
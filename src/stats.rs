@@ -0,0 +1,324 @@
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+
+// Steps a frame goes through. Each tool times the ones it has:
+// decode: reading and parsing the input
+// map: turning input values into positions (channel mapping, frequency analysis, ...)
+// render: turning positions into the output (interpolation and timing, points of a frame, ...)
+// write: encoding and writing the output
+#[derive(Clone, Copy)]
+pub enum Stage {
+    Decode,
+    Map,
+    Render,
+    Write,
+}
+
+const STAGES: [&str; 4] = ["decode", "map", "render", "write"];
+
+// Stage times are counted in buckets of powers of two nanoseconds, the last bucket takes everything from
+// about 2 s on.
+const BUCKETS: usize = 32;
+
+const REPORT_INTERVAL: Duration = Duration::from_secs(1);
+
+#[derive(Clone, Copy)]
+pub enum Format {
+    Text,
+    Json,
+}
+
+impl Format {
+    // the value of a --stats option, text if none is given
+    pub fn parse(value: Option<&str>) -> Option<Format> {
+        match value {
+            None | Some("text") => Some(Format::Text),
+            Some("json") => Some(Format::Json),
+            _ => None,
+        }
+    }
+}
+
+#[derive(Default)]
+struct Histogram {
+    buckets: [AtomicU64; BUCKETS],
+    sum: AtomicU64,
+    max: AtomicU64,
+}
+
+// A histogram taken out for a report
+struct Snapshot {
+    buckets: [u64; BUCKETS],
+    count: u64,
+    sum: u64,
+    max: u64,
+}
+
+impl Histogram {
+    fn record(&self, nanos: u64) {
+        let bucket = (64 - nanos.leading_zeros() as usize).min(BUCKETS - 1);
+        self.buckets[bucket].fetch_add(1, Ordering::Relaxed);
+        self.sum.fetch_add(nanos, Ordering::Relaxed);
+        self.max.fetch_max(nanos, Ordering::Relaxed);
+    }
+
+    fn take(&self) -> Snapshot {
+        let mut buckets = [0; BUCKETS];
+        for (count, bucket) in buckets.iter_mut().zip(&self.buckets) {
+            *count = bucket.swap(0, Ordering::Relaxed);
+        }
+        Snapshot {
+            buckets,
+            count: buckets.iter().sum(),
+            sum: self.sum.swap(0, Ordering::Relaxed),
+            max: self.max.swap(0, Ordering::Relaxed),
+        }
+    }
+}
+
+impl Snapshot {
+    fn mean_ms(&self) -> f64 {
+        self.sum as f64 / self.count.max(1) as f64 / 1e6
+    }
+
+    // upper bound of the bucket that holds the given share of all times
+    fn percentile_ms(&self, share: f64) -> f64 {
+        let rank = (self.count as f64 * share).ceil().max(1.0) as u64;
+        let mut seen = 0;
+        for (bucket, count) in self.buckets.iter().enumerate() {
+            seen += count;
+            if seen >= rank {
+                return ((1u64 << bucket) as f64 / 1e6).min(self.max as f64 / 1e6);
+            }
+        }
+        self.max as f64 / 1e6
+    }
+
+    fn max_ms(&self) -> f64 {
+        self.max as f64 / 1e6
+    }
+}
+
+// Runtime statistics of a tool (--stats), reported to STDERR about once per second.
+// Every report covers the time since the previous one. Recording only touches atomics, so any thread
+// can record without locking.
+pub struct Stats {
+    format: Format,
+    started: Instant,
+    stages: [Histogram; 4],
+    frames: AtomicU64,
+    points: AtomicU64,
+    samples: AtomicU64,
+    over_budget: AtomicU64,
+    dropped_points: AtomicU64,
+    dropped_frames: AtomicU64,
+    queue: AtomicUsize,
+    queue_max: AtomicUsize,
+    // time of the previous report
+    reported: Mutex<Instant>,
+}
+
+impl Stats {
+    // Starts reporting in the given format until the statistics are dropped.
+    pub fn start(format: Format) -> Arc<Stats> {
+        let now = Instant::now();
+        let stats = Arc::new(Stats {
+            format,
+            started: now,
+            stages: Default::default(),
+            frames: AtomicU64::new(0),
+            points: AtomicU64::new(0),
+            samples: AtomicU64::new(0),
+            over_budget: AtomicU64::new(0),
+            dropped_points: AtomicU64::new(0),
+            dropped_frames: AtomicU64::new(0),
+            queue: AtomicUsize::new(0),
+            queue_max: AtomicUsize::new(0),
+            reported: Mutex::new(now),
+        });
+
+        let reporter = Arc::downgrade(&stats);
+        thread::spawn(move || loop {
+            thread::sleep(REPORT_INTERVAL);
+            match reporter.upgrade() {
+                Some(stats) => stats.report(),
+                None => break,
+            }
+        });
+
+        stats
+    }
+
+    pub fn time(&self, stage: Stage, duration: Duration) {
+        self.stages[stage as usize].record(duration.as_nanos() as u64);
+    }
+
+    // a frame with the given amount of points was done
+    pub fn frame(&self, points: usize) {
+        self.frames.fetch_add(1, Ordering::Relaxed);
+        self.points.fetch_add(points as u64, Ordering::Relaxed);
+    }
+
+    // samples per channel that were read or written
+    pub fn samples(&self, samples: usize) {
+        self.samples.fetch_add(samples as u64, Ordering::Relaxed);
+    }
+
+    // a frame took longer than the time it has
+    pub fn over_budget(&self) {
+        self.over_budget.fetch_add(1, Ordering::Relaxed);
+    }
+
+    // points of a frame that did not make it into the output
+    pub fn dropped_points(&self, points: usize) {
+        self.dropped_points
+            .fetch_add(points as u64, Ordering::Relaxed);
+    }
+
+    // frames that were skipped to keep up with the clock
+    pub fn dropped_frames(&self, frames: usize) {
+        self.dropped_frames
+            .fetch_add(frames as u64, Ordering::Relaxed);
+    }
+
+    // items that wait between two stages
+    pub fn queue(&self, depth: usize) {
+        self.queue.store(depth, Ordering::Relaxed);
+        self.queue_max.fetch_max(depth, Ordering::Relaxed);
+    }
+
+    // Prints everything recorded since the previous report.
+    pub fn report(&self) {
+        let mut reported = self.reported.lock().unwrap();
+        let now = Instant::now();
+        let seconds = (now - *reported).as_secs_f64().max(1e-9);
+        *reported = now;
+
+        let frames = self.frames.swap(0, Ordering::Relaxed);
+        let points = self.points.swap(0, Ordering::Relaxed);
+        let samples = self.samples.swap(0, Ordering::Relaxed);
+        let over_budget = self.over_budget.swap(0, Ordering::Relaxed);
+        let dropped_points = self.dropped_points.swap(0, Ordering::Relaxed);
+        let dropped_frames = self.dropped_frames.swap(0, Ordering::Relaxed);
+        let queue = self.queue.load(Ordering::Relaxed);
+        let queue_max = self.queue_max.swap(queue, Ordering::Relaxed);
+        let stages: Vec<_> = STAGES
+            .iter()
+            .zip(&self.stages)
+            .map(|(name, histogram)| (name, histogram.take()))
+            .filter(|(_, snapshot)| snapshot.count > 0)
+            .collect();
+
+        match self.format {
+            Format::Text => {
+                let mut line = format!(
+                    "Stats: {:.1} frames/s, {:.0} points/s, {:.0} samples/s, over budget: {}, dropped points: {}, dropped frames: {}, queue: {} (max {})",
+                    frames as f64 / seconds,
+                    points as f64 / seconds,
+                    samples as f64 / seconds,
+                    over_budget,
+                    dropped_points,
+                    dropped_frames,
+                    queue,
+                    queue_max
+                );
+                for (name, snapshot) in &stages {
+                    line += &format!(
+                        ", {}: {:.3}/{:.3}/{:.3} ms",
+                        name,
+                        snapshot.mean_ms(),
+                        snapshot.percentile_ms(0.99),
+                        snapshot.max_ms()
+                    );
+                }
+                eprintln!("{}", line);
+            }
+            Format::Json => {
+                let stages: Vec<String> = stages
+                    .iter()
+                    .map(|(name, snapshot)| {
+                        let buckets: Vec<String> =
+                            snapshot.buckets.iter().map(u64::to_string).collect();
+                        format!(
+                            r#""{}":{{"count":{},"mean_ms":{:.6},"p50_ms":{:.6},"p99_ms":{:.6},"max_ms":{:.6},"histogram":[{}]}}"#,
+                            name,
+                            snapshot.count,
+                            snapshot.mean_ms(),
+                            snapshot.percentile_ms(0.5),
+                            snapshot.percentile_ms(0.99),
+                            snapshot.max_ms(),
+                            buckets.join(",")
+                        )
+                    })
+                    .collect();
+                eprintln!(
+                    r#"{{"elapsed":{:.3},"seconds":{:.3},"frames":{},"points":{},"samples":{},"points_per_second":{:.1},"samples_per_second":{:.1},"over_budget":{},"dropped_points":{},"dropped_frames":{},"queue":{},"queue_max":{},"stages":{{{}}}}}"#,
+                    (now - self.started).as_secs_f64(),
+                    seconds,
+                    frames,
+                    points,
+                    samples,
+                    points as f64 / seconds,
+                    samples as f64 / seconds,
+                    over_budget,
+                    dropped_points,
+                    dropped_frames,
+                    queue,
+                    queue_max,
+                    stages.join(",")
+                );
+            }
+        }
+    }
+}
+
+// Times consecutive stages of a frame. Does nothing without statistics.
+pub struct StageTimer<'a> {
+    stats: Option<&'a Stats>,
+    last: Option<Instant>,
+}
+
+impl<'a> StageTimer<'a> {
+    pub fn new(stats: Option<&'a Stats>) -> StageTimer<'a> {
+        StageTimer {
+            stats,
+            last: stats.map(|_| Instant::now()),
+        }
+    }
+
+    // Records the time since the previous lap for stage and returns it.
+    pub fn lap(&mut self, stage: Stage) -> Duration {
+        match (self.stats, self.last.as_mut()) {
+            (Some(stats), Some(last)) => {
+                let now = Instant::now();
+                let duration = now - *last;
+                *last = now;
+                stats.time(stage, duration);
+                duration
+            }
+            _ => Duration::from_secs(0),
+        }
+    }
+}
+
+// Times every item of an iterator as the given stage.
+pub fn timed<'a, I>(
+    iter: I,
+    stats: Option<Arc<Stats>>,
+    stage: Stage,
+) -> impl Iterator<Item = I::Item> + 'a
+where
+    I: Iterator + 'a,
+{
+    let mut iter = iter;
+    std::iter::from_fn(move || {
+        let mut timer = StageTimer::new(stats.as_deref());
+        let item = iter.next();
+        if item.is_some() {
+            timer.lap(stage);
+        }
+        item
+    })
+}
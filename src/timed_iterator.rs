@@ -0,0 +1,134 @@
+use std::hint;
+use std::thread;
+use std::time::{Duration, Instant};
+
+#[derive(Copy, Clone)]
+pub enum TimedIteratorStrategy {
+    Sleep,
+    Repeat,
+}
+
+// What happens to items whose time has already passed.
+#[derive(Copy, Clone)]
+pub enum DropPolicy {
+    // Never skip an item, late items are yielded right away until the schedule is met again.
+    Never,
+    // Skip items that are more than this many periods late, so the output keeps up with the clock.
+    After(u32),
+}
+
+// thread::sleep often oversleeps by a few ms, the last part of every wait is spent spinning instead
+const SPIN: Duration = Duration::from_millis(2);
+
+// Yields the items of the underlying iterator at a fixed rate.
+// The time of every item is derived from its index on a monotonic clock, so errors never add up.
+#[derive(Copy, Clone)]
+pub struct TimedIterator<I>
+where
+    I: Iterator,
+    I::Item: Clone,
+{
+    // in seconds
+    period: f64,
+    // index of the next item
+    tick: u64,
+    underlying: I,
+    reference: Instant,
+    strategy: TimedIteratorStrategy,
+    drop_policy: DropPolicy,
+    dropped: u64,
+    current: Option<I::Item>,
+}
+
+impl<I> TimedIterator<I>
+where
+    I: Iterator,
+    I::Item: Clone,
+{
+    pub fn drop_policy(mut self, drop_policy: DropPolicy) -> Self {
+        self.drop_policy = drop_policy;
+        self
+    }
+
+    // number of items that were skipped by the drop policy so far
+    pub fn dropped(&self) -> u64 {
+        self.dropped
+    }
+
+    fn time(&self, tick: u64) -> Instant {
+        self.reference + Duration::from_secs_f64(self.period * tick as f64)
+    }
+
+    // Skips the items that are too late at now, returns None if the underlying iterator ended.
+    fn skip_late(&mut self, now: Instant) -> Option<()> {
+        if let DropPolicy::After(periods) = self.drop_policy {
+            while self.time(self.tick + periods as u64) < now {
+                self.underlying.next()?;
+                self.tick += 1;
+                self.dropped += 1;
+            }
+        }
+        Some(())
+    }
+}
+
+fn wait_until(time: Instant) {
+    let now = Instant::now();
+    if time > now + SPIN {
+        thread::sleep(time - now - SPIN);
+    }
+    while Instant::now() < time {
+        hint::spin_loop();
+    }
+}
+
+impl<I> Iterator for TimedIterator<I>
+where
+    I: Iterator,
+    I::Item: Clone,
+{
+    type Item = I::Item;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let now = Instant::now();
+
+        match self.strategy {
+            TimedIteratorStrategy::Repeat => {
+                if self.time(self.tick) <= now {
+                    self.skip_late(now)?;
+                    self.current = self.underlying.next();
+                    self.tick += 1;
+                }
+                self.current.clone()
+            }
+            TimedIteratorStrategy::Sleep => {
+                self.skip_late(now)?;
+                wait_until(self.time(self.tick));
+
+                self.tick += 1;
+                self.underlying.next()
+            }
+        }
+    }
+}
+
+pub trait TimedExt: Iterator {
+    fn timed(self, fps: f64, strategy: TimedIteratorStrategy) -> TimedIterator<Self>
+    where
+        Self: Sized,
+        Self::Item: Clone,
+    {
+        TimedIterator {
+            period: 1.0 / fps,
+            tick: 0,
+            underlying: self,
+            reference: Instant::now(),
+            strategy,
+            drop_policy: DropPolicy::Never,
+            dropped: 0,
+            current: None,
+        }
+    }
+}
+
+impl<I: Iterator> TimedExt for I {}